@@ -0,0 +1,43 @@
+#ifndef BOUNDS_CLASS_H
+#define BOUNDS_CLASS_H
+
+#include "./glm/glm.hpp"
+#include <cfloat>
+
+// Axis aligned bounding box, empty until a point is added
+class BoundingBox
+{
+public:
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    BoundingBox(){};
+    BoundingBox(glm::vec3 _min, glm::vec3 _max) : min(_min), max(_max){};
+
+    bool isEmpty() const { return min.x > max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 size() const { return max - min; }
+
+    // Grows the box to contain the point or the other box
+    void expand(glm::vec3 point);
+    void merge(const BoundingBox &box);
+
+    bool contains(glm::vec3 point) const;
+    // Slab test, t is the distance along dir to the entry point (0 if the origin is inside)
+    bool intersectRay(glm::vec3 origin, glm::vec3 dir, float &t) const;
+};
+
+class BoundingSphere
+{
+public:
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    BoundingSphere(){};
+    // Sphere around the box (half of its diagonal), no extra pass over the vertices
+    BoundingSphere(const BoundingBox &box);
+
+    bool contains(glm::vec3 point) const;
+};
+
+#endif
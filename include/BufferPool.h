@@ -0,0 +1,68 @@
+#ifndef BUFFER_POOL_CLASS_H
+#define BUFFER_POOL_CLASS_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+
+#include "MemoryTracker.h"
+
+using namespace std;
+
+// Keeps the capacity of the regeneration buffers between resets, they only grow
+// when a bigger size is requested so scrubbing the dimension stops allocating
+// once the largest size has been seen
+class BufferPool
+{
+public:
+    // Resizes a pooled buffer, the capacity grows geometrically and never shrinks
+    // Every grow is accounted to tag in the MemoryTracker
+    template <typename T>
+    void fit(vector<T> &buffer, size_t count, MemoryTag tag)
+    {
+        if (count > buffer.capacity())
+        {
+            size_t oldCapacity = buffer.capacity();
+            buffer.reserve(max(count, 2 * buffer.capacity()));
+            allocations++;
+            if (oldCapacity > 0)
+                MemoryTracker::release(tag, oldCapacity * sizeof(T));
+            MemoryTracker::allocate(tag, buffer.capacity() * sizeof(T));
+        }
+        buffer.resize(count);
+    }
+
+    // Registers a buffer so it's included in the reserved/used memory, it's kept by
+    // reference so the owner of the buffer must not be copied or moved
+    template <typename T>
+    void track(const string &name, vector<T> &buffer)
+    {
+        TrackedBuffer tracked;
+        tracked.name = name;
+        tracked.reserved = [&buffer]()
+        { return buffer.capacity() * sizeof(T); };
+        tracked.used = [&buffer]()
+        { return buffer.size() * sizeof(T); };
+        buffers.push_back(tracked);
+    }
+
+    // Bytes held by the pooled buffers
+    size_t reservedBytes() const;
+    // Bytes used by the last regeneration
+    size_t usedBytes() const;
+    // Times a buffer had to grow, stays the same in steady state
+    size_t getAllocations() const { return allocations; }
+
+private:
+    struct TrackedBuffer
+    {
+        string name;
+        function<size_t()> reserved;
+        function<size_t()> used;
+    };
+    vector<TrackedBuffer> buffers;
+    size_t allocations = 0;
+};
+
+#endif
@@ -5,13 +5,22 @@
 #include <glad/glad.h>
 #include <vector>
 
+#include "MemoryTracker.h"
+
 using namespace std;
 
 class EBO
 {
 public:
     GLuint ID;
+    // Bytes given to the driver by the last upload
+    GLsizeiptr size = 0;
     EBO(vector<GLuint> &indices);
+    // Generates an empty buffer, filled later with update
+    EBO();
+
+    // Replaces the indices, the VAO that should keep them must be bound
+    void update(vector<GLuint> &indices);
 
     void Bind();
     void Unbind();
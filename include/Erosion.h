@@ -0,0 +1,153 @@
+#ifndef EROSION_CLASS_H
+#define EROSION_CLASS_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+using namespace std;
+
+// Side of the tiles the droplets of a batch are split in, a droplet never leaves
+// the area of half a tile around its own, so tiles two apart never touch the same samples
+const int EROSION_TILE_SIZE = 64;
+
+struct ErosionOptions
+{
+    unsigned int seed = 0;
+    // Droplets of the whole run and of each batch, a preview is published after every batch
+    int droplets = 200000;
+    int batchSize = 20000;
+    // Steps a droplet lives
+    int lifetime = 30;
+    // Samples around the droplet it takes the sediment from
+    int radius = 3;
+    // 0 follows the slope, 1 keeps the direction
+    float inertia = 0.05f;
+    // Sediment carried per unit of speed, water and slope
+    float capacity = 4.0f;
+    float minCapacity = 0.01f;
+    float erodeSpeed = 0.3f;
+    float depositSpeed = 0.3f;
+    float evaporateSpeed = 0.01f;
+    float gravity = 4.0f;
+};
+
+// Particle based hydraulic erosion: droplets run down the heightmap taking sediment
+// where they speed up and leaving it where they slow down or the water evaporates
+// A batch runs in four phases, each phase takes one tile out of every 2x2 block so
+// the tiles of a phase can be simulated in parallel without locks. Every tile has its
+// own random sequence, the result doesn't depend on the number of threads
+class HydraulicErosion
+{
+public:
+    // width x height samples, row-major
+    HydraulicErosion(int width, int height, const ErosionOptions &options);
+
+    // Simulates about count droplets in place, returns how many were simulated
+    int runBatch(float *heights, int count, int threads);
+
+    const ErosionOptions &getOptions() const { return options; }
+
+private:
+    int width, height;
+    ErosionOptions options;
+    int tilesX, tilesY;
+    // Batches run so far, part of the random sequence of the tiles
+    int batches = 0;
+    // Offsets of the samples within the radius and their share of the erosion
+    vector<int> brushX, brushY;
+    vector<float> brushWeights;
+
+    // Droplets starting in tile (tx, ty)
+    void runTile(float *heights, int tx, int ty, int count);
+    // Bilinear height and gradient at (x, y), both inside the map
+    void sample(const float *heights, float x, float y, float &h, float &gradX, float &gradY) const;
+};
+
+struct ThermalOptions
+{
+    // Height difference between neighbor samples that stays in place, the tangent of
+    // the talus angle in noise units per sample
+    float talus = 0.01f;
+    // Share of the excess moved per iteration, 1 levels a pair of samples to the talus
+    float rate = 0.5f;
+    // Iterations of the whole run and of each batch
+    int iterations = 200;
+    int batchSize = 4;
+    // Converged once no sample moves more than this in an iteration
+    float tolerance = 1e-5f;
+};
+
+// Talus angle thermal erosion: material slides from every sample to the 4 neighbors
+// that are lower than the talus allows, which wears the cliffs down to that slope
+// Every iteration reads one buffer and writes the other (Jacobi), so the rows can
+// be split over threads and the inner loop is branchless for the vectorizer
+// Each pair of neighbors exchanges the same amount both ways, no material is lost
+class ThermalErosion
+{
+public:
+    ThermalErosion(int width, int height, const ThermalOptions &options);
+
+    // Runs up to count iterations on heights (swapped with the second buffer), it stops
+    // early once converged. Returns the iterations run, 0 when already converged
+    int run(vector<float> &heights, int count, int threads);
+
+    bool isConverged() { return converged; }
+    // Samples that moved more than the tolerance in the last iteration
+    int getLastMoving() { return lastMoving; }
+    const ThermalOptions &getOptions() const { return options; }
+
+private:
+    int width, height;
+    ThermalOptions options;
+    vector<float> next;
+    bool converged = false;
+    int lastMoving = 0;
+
+    // Rows [firstRow, lastRow) of one iteration, returns the samples that moved more than the tolerance
+    int iterateRows(const float *heights, float *out, int firstRow, int lastRow) const;
+    // Same for a sample on the border, where some neighbors are missing
+    bool iterateBorder(const float *heights, float *out, int x, int y) const;
+};
+
+// Runs a simulation off the main thread on a copy of the heights. After every
+// batch the main thread can pick up the heights so far to show the progress
+class ErosionTask
+{
+public:
+    // Simulates at most limit units (droplets, iterations) in place and returns how many, 0 ends the run
+    typedef function<size_t(vector<float> &heights, size_t limit)> Batch;
+
+    ~ErosionTask() { stop(); }
+
+    // Stops the previous run and starts batches until budget units are done
+    void start(const vector<float> &heights, size_t budget, Batch batch);
+    // The run ends after the current batch, its heights are still published
+    void stop();
+    bool isRunning() { return running; }
+    // Copies the heights of the last batch, only if they weren't taken already
+    bool takeHeights(vector<float> &heights);
+    size_t getDone() { return done; }
+    // Units per second of the run so far
+    float getRate();
+
+private:
+    vector<float> working, published;
+    // Guards published and fresh
+    mutex publishMutex;
+    bool fresh = false;
+    atomic<bool> running{false}, cancelled{false};
+    atomic<size_t> done{0};
+    double startTime = 0.0;
+    atomic<double> endTime{0.0};
+    thread worker;
+
+    // Copies working to published, unless the last copy wasn't taken and force is false
+    void publish(bool force);
+    static double now();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef GOLDEN_CHECK_CLASS_H
+#define GOLDEN_CHECK_CLASS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+#include "Terrain.h"
+
+using namespace std;
+
+// Grid points sampled per case, only reported to tell last bit drift (another
+// compiler or math library) from a real change, both checksums must match exactly
+const int GOLDEN_SAMPLES = 9;
+
+// One terrain of the matrix
+struct GoldenCase
+{
+    unsigned int seed;
+    int dimension, layers;
+    float frequency, persistance, lacunarity;
+};
+
+struct GoldenResult
+{
+    uint64_t heightmap; // checksum of the noise values
+    uint64_t mesh;      // checksum of the vertex streams and the indices
+    size_t copiedBytes; // buffers copied by the pipeline, only the result cache copies
+    float samples[GOLDEN_SAMPLES];
+};
+
+// Regenerates a fixed matrix of seeds and options through Terrain (checkUpdate,
+// the same path as the UI) and compares the output with the stored results,
+// once for every thread count
+// TERRAIN_BLESS=golden/terrain.txt ./app writes the file, TERRAIN_VERIFY=... checks it
+// tools/golden_check checks the heightmaps without a window (no mesh)
+class GoldenCheck
+{
+public:
+    static vector<GoldenCase> getMatrix();
+    static vector<int> getThreadCounts();
+
+    static GoldenResult run(Terrain &terrain, const GoldenCase &test, int threads);
+    // Stores the single threaded results of the matrix
+    static bool bless(Terrain &terrain, const string &path);
+    // Returns the number of failed checks, the details go to out
+    static int verify(Terrain &terrain, const string &path, ostream &out);
+
+private:
+    // A preview released on options that are in the cache must take them, not refine again
+    static bool checkPreviewRelease(Terrain &terrain, ostream &out);
+    static uint64_t checksum(const void *data, size_t bytes, uint64_t hash);
+};
+
+#endif
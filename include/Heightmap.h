@@ -0,0 +1,157 @@
+#ifndef HEIGHTMAP_CLASS_H
+#define HEIGHTMAP_CLASS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+// Samples of a map, row-major, height rows of width values
+struct Heightmap
+{
+    int width = 0, height = 0;
+    vector<float> samples;
+
+    float at(int x, int y) const { return samples[(size_t)y * width + x]; }
+};
+
+// Headerless formats, the usual .r32 / .r16 files of the terrain tools
+// Without a width the map is taken as square and the side comes from the file size
+class HeightmapIO
+{
+public:
+    static bool saveRaw32(const string &path, const Heightmap &map);
+    static bool loadRaw32(const string &path, Heightmap &map, int width = 0);
+    // Unsigned 16 bit, the lowest sample is stored as 0 and the highest as 65535
+    static bool saveRaw16(const string &path, const Heightmap &map);
+    // The range isn't stored, the samples come back in [0, 1]
+    static bool loadRaw16(const string &path, Heightmap &map, int width = 0);
+
+private:
+    static bool readFile(const string &path, vector<char> &bytes);
+    static bool getSize(size_t samples, int width, Heightmap &map);
+};
+
+const char TILED_MAGIC[4] = {'H', 'M', 'T', 'L'};
+const uint32_t TILED_VERSION = 2;
+
+// What the 4 bytes of a sample hold
+enum TileFormat
+{
+    TILE_FLOAT32 = 0,      // height
+    TILE_NORMAL_RGBA8 = 1, // unit normal, (n * 0.5 + 0.5) * 255 in RGB
+};
+
+// Start of a tiled heightmap file, followed by the tile index and the tiles
+// Level 0 is the full map, every level halves the previous one until it fits in a tile
+struct TiledHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width, height; // samples of level 0
+    uint32_t tileSize;      // tiles are tileSize x tileSize samples of 4 bytes
+    uint32_t levels;
+    uint32_t format; // TileFormat
+    uint32_t reserved;
+    float minHeight, maxHeight;
+
+    int levelWidth(int level) const { return max(1, (int)((width + (1u << level) - 1) >> level)); }
+    int levelHeight(int level) const { return max(1, (int)((height + (1u << level) - 1) >> level)); }
+    int tilesX(int level) const { return (levelWidth(level) + tileSize - 1) / tileSize; }
+    int tilesY(int level) const { return (levelHeight(level) + tileSize - 1) / tileSize; }
+    // Position of the tile in the index, the levels are stored one after the other
+    size_t tileIndex(int level, int tx, int ty) const;
+    size_t tileCount() const { return tileIndex(levels, 0, 0); }
+    size_t tileBytes() const { return (size_t)tileSize * tileSize * 4; }
+    // Header of an empty map, the range is filled as the tiles come in
+    static TiledHeader describe(uint32_t width, uint32_t height, uint32_t tileSize, TileFormat format);
+    // Levels needed for a map of this size
+    static uint32_t countLevels(uint32_t width, uint32_t height, uint32_t tileSize);
+};
+static_assert(sizeof(TiledHeader) == 40, "TiledHeader is stored as is");
+
+// Where each tile is in the file
+struct TileEntry
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Writes a tiled heightmap one level 0 tile at a time, finish() builds the
+// mip pyramid reading back four tiles at a time, so the whole map is never in memory
+// The tiles can be written in any order and from several threads
+class TiledHeightmapWriter
+{
+public:
+    // Closes a file that wasn't finished, its index and levels are left unwritten
+    ~TiledHeightmapWriter();
+
+    // resume keeps the tiles already in the file (the size and format must be the same)
+    bool create(const string &path, int width, int height, int tileSize, TileFormat format = TILE_FLOAT32, bool resume = false);
+    // tileSize x tileSize samples, the ones past the edge of the map are padding
+    bool writeTile(int tx, int ty, const void *tile);
+    // Makes the tiles written so far durable, before recording them in a checkpoint
+    bool sync();
+    bool finish();
+
+    const TiledHeader &getHeader() const { return header; }
+    // Height range of the tiles written, restored by a resumed writer
+    void getRange(float &minHeight, float &maxHeight);
+    void setRange(float minHeight, float maxHeight);
+
+    // Stores a whole map (padded by repeating the edge)
+    static bool write(const string &path, const Heightmap &map, int tileSize);
+    // Tile (tx, ty) of level from block, the 2x2 tiles under it in the previous
+    // level as 2 tileSize x 2 tileSize samples (the missing ones past the edge are never read)
+    static void downsample(const TiledHeader &header, int level, int tx, int ty, const float *block, float *tile);
+
+private:
+    int fd = -1;
+    TiledHeader header;
+    vector<TileEntry> index;
+
+    mutex rangeMutex;
+
+    bool readTile(int level, int tx, int ty, void *tile);
+    bool writeTile(int level, int tx, int ty, const void *tile);
+};
+
+// Normal packing of TILE_NORMAL_RGBA8
+uint32_t packNormal(float x, float y, float z);
+void unpackNormal(uint32_t packed, float normal[3]);
+
+// Read only view of a tiled heightmap through mmap, only the tiles that are
+// touched get loaded by the OS
+class TiledHeightmap
+{
+public:
+    TiledHeightmap() {}
+    ~TiledHeightmap() { close(); }
+    TiledHeightmap(const TiledHeightmap &) = delete;
+    TiledHeightmap &operator=(const TiledHeightmap &) = delete;
+
+    bool open(const string &path);
+    void close();
+
+    const TiledHeader &getHeader() const { return *header; }
+    // Pointer to the tileSize x tileSize samples inside the mapping (TILE_FLOAT32)
+    const float *getTile(int level, int tx, int ty) const;
+    float sample(int level, int x, int y) const;
+    // Copies w x h samples starting at (x, y), clamped to the edges of the level
+    void readRegion(int level, int x, int y, int w, int h, float *out) const;
+    Heightmap readLevel(int level) const;
+    // Finest level with both sides at most maxSide samples
+    int levelFor(int maxSide) const;
+
+private:
+    const char *data = nullptr;
+    size_t length = 0;
+    const TiledHeader *header = nullptr;
+    const TileEntry *index = nullptr;
+};
+
+#endif
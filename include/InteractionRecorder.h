@@ -0,0 +1,94 @@
+#ifndef INTERACTION_RECORDER_CLASS_H
+#define INTERACTION_RECORDER_CLASS_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "Terrain.h"
+#include "camera.h"
+
+using namespace std;
+
+// Nanoseconds finishFrames waits for the GPU to complete a frame
+const GLuint64 FRAME_WAIT_TIMEOUT = 1000000000;
+
+// Terrain options and camera location, everything a user can change
+struct InteractionState
+{
+    int layers, dimension;
+    float frequency, persistance, lacunarity, mapHeight, distance;
+    glm::vec3 cameraPos, cameraFront;
+    float yaw, pitch;
+    // A noise slider held down, the terrain is a coarse preview meanwhile
+    bool preview = false;
+
+    static InteractionState capture(const Terrain &terrain, const Camera &camera);
+    void apply(Terrain &terrain, Camera &camera) const;
+    bool operator==(const InteractionState &other) const;
+    bool operator!=(const InteractionState &other) const { return !(*this == other); }
+};
+
+struct InteractionEvent
+{
+    double time; // seconds since the recording started
+    InteractionState state;
+};
+
+// Records the parameter changes and camera moves of a session and replays them
+// with the same timing, measuring the time from each change until the frame that
+// shows it has been completed by the GPU
+class InteractionRecorder
+{
+public:
+    enum Mode
+    {
+        IDLE,
+        RECORDING,
+        REPLAYING
+    };
+
+    void startRecording(double now, const Terrain &terrain, const Camera &camera);
+    // Called once per frame, stores the state when it changed
+    void record(double now, const Terrain &terrain, const Camera &camera);
+    // Saves the events as text, one per line
+    bool stopRecording(const string &path);
+
+    bool startReplay(const string &path, double now);
+    // Applies the events that are due, returns true if any was applied
+    bool replay(double now, Terrain &terrain, Camera &camera);
+    // Seconds until the next event, the render loop must be awake by then
+    double timeToNextEvent(double now) const;
+
+    // Called after the swap, fences the changes applied in this frame
+    void frameSubmitted();
+    // Waits for the GPU to finish the fenced frames and takes their latencies when
+    // the fences signal. Called right after frameSubmitted, before the frame cap sleep
+    void finishFrames();
+    // A frame wasn't finished in time, the loop should keep drawing until it is
+    bool isBusy() const { return !pending.empty(); }
+
+    Mode getMode() const { return mode; }
+    size_t getEventCount() const { return events.size(); }
+    const vector<float> &getLatencies() const { return latencies; }
+    // Latency in ms below which p percent of the changes were shown
+    float percentile(float p) const;
+    void report(ostream &out) const;
+
+private:
+    struct PendingChange
+    {
+        double due; // when the change should have happened
+        GLsync fence;
+    };
+    Mode mode = IDLE;
+    vector<InteractionEvent> events;
+    size_t nextEvent = 0;
+    double startTime = 0.0;
+    // Changes applied and not visible yet, fence is 0 until the frame is submitted
+    vector<PendingChange> pending;
+    vector<float> latencies;
+};
+
+#endif
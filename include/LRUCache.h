@@ -0,0 +1,105 @@
+#ifndef LRU_CACHE_CLASS_H
+#define LRU_CACHE_CLASS_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <cstddef>
+
+using namespace std;
+
+// Keeps the most recently used values up to a budget of bytes, every value
+// says what it costs when it's put. Not thread safe, callers that share it lock around it
+template <typename Key, typename Value, typename Hash = hash<Key>>
+class LRUCache
+{
+public:
+    LRUCache(size_t budget = 0) : budget(budget) {}
+
+    // Copies the value out and makes it the most recent one
+    bool get(const Key &key, Value &value)
+    {
+        auto found = entries.find(key);
+        if (found == entries.end())
+        {
+            misses++;
+            return false;
+        }
+        order.splice(order.begin(), order, found->second);
+        value = found->second->value;
+        hits++;
+        return true;
+    }
+
+    // Doesn't count as a hit or a miss, nor changes the order
+    bool contains(const Key &key) const { return entries.count(key) > 0; }
+
+    // A value bigger than the whole budget isn't kept
+    void put(const Key &key, Value value, size_t cost)
+    {
+        erase(key);
+        if (cost > budget)
+            return;
+        order.push_front({key, move(value), cost});
+        entries[key] = order.begin();
+        bytes += cost;
+        evict();
+    }
+
+    void erase(const Key &key)
+    {
+        auto found = entries.find(key);
+        if (found == entries.end())
+            return;
+        bytes -= found->second->cost;
+        order.erase(found->second);
+        entries.erase(found);
+    }
+
+    void clear()
+    {
+        order.clear();
+        entries.clear();
+        bytes = 0;
+    }
+
+    void setBudget(size_t _budget)
+    {
+        budget = _budget;
+        evict();
+    }
+
+    size_t getBudget() const { return budget; }
+    size_t getBytes() const { return bytes; }
+    size_t size() const { return entries.size(); }
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+    size_t getEvictions() const { return evictions; }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+    // Most recent first
+    list<Entry> order;
+    unordered_map<Key, typename list<Entry>::iterator, Hash> entries;
+    size_t budget;
+    size_t bytes = 0;
+    size_t hits = 0, misses = 0, evictions = 0;
+
+    void evict()
+    {
+        while (bytes > budget && !order.empty())
+        {
+            bytes -= order.back().cost;
+            entries.erase(order.back().key);
+            order.pop_back();
+            evictions++;
+        }
+    }
+};
+
+#endif
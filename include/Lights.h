@@ -0,0 +1,54 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "./glm/glm.hpp"
+
+// std140 mirrors of the light structs in default.frag, the vec3s are padded to 16 bytes
+
+// Must match NR_POINT_LIGHTS in default.frag
+const int NR_POINT_LIGHTS = 4;
+
+struct DirLight
+{
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct PointLight
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float pad0;
+    glm::vec3 specular;
+    float pad1;
+};
+
+struct SpotLight
+{
+    PointLight pointLight;
+    float cutOffAngle;
+    float outerCutOffAngle;
+    float pad[2];
+};
+
+// Content of the Lights uniform block
+struct LightsBlock
+{
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+static_assert(sizeof(LightsBlock) == 480, "LightsBlock must follow the std140 layout");
+
+#endif
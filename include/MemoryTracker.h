@@ -0,0 +1,53 @@
+#ifndef MEMORY_TRACKER_CLASS_H
+#define MEMORY_TRACKER_CLASS_H
+
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+
+using namespace std;
+
+// Subsystems the memory is accounted to
+enum MemoryTag
+{
+    MEM_HEIGHTMAP,
+    MEM_ADJACENCY,
+    MEM_VERTEX,
+    MEM_INDEX,
+    MEM_GPU_BUFFERS,
+    MEM_TEXTURES,
+    MEM_RESULT_CACHE,
+    MEM_TAG_COUNT
+};
+
+struct MemoryStats
+{
+    size_t current = 0;     // bytes held right now
+    size_t peak = 0;        // highest current seen
+    size_t allocations = 0; // buffers created (or grown, for the CPU buffers)
+    long live = 0;          // buffers created and not released yet
+};
+
+// Registry of the memory held by each subsystem, the CPU buffers report their
+// capacity and the GPU objects the size given to the driver
+// A live count that keeps growing means objects are created and never deleted
+class MemoryTracker
+{
+public:
+    // A new buffer of bytes
+    static void allocate(MemoryTag tag, size_t bytes);
+    // The buffer changed size, it's still the same object
+    static void resize(MemoryTag tag, size_t oldBytes, size_t newBytes);
+    static void release(MemoryTag tag, size_t bytes);
+
+    static MemoryStats get(MemoryTag tag);
+    static const char *getName(MemoryTag tag);
+    // One line per subsystem, for the console and the benchmarks
+    static void report(ostream &out);
+
+private:
+    static MemoryStats stats[MEM_TAG_COUNT];
+    static mutex statsMutex;
+};
+
+#endif
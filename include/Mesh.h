@@ -10,6 +10,18 @@ using namespace std;
 #include "EBO.h"
 #include "camera.h"
 #include "Texture.h"
+#include "Bounds.h"
+#include "Profiler.h"
+
+// Non-interleaved vertex attribute with its own buffer, only re-uploaded when dirty
+struct VertexStream
+{
+	GLuint layout;
+	GLuint numComponents;
+	vector<GLfloat> data;
+	VBO buffer;
+	bool dirty = true;
+};
 
 class Mesh
 {
@@ -17,18 +29,53 @@ public:
 	vector<Vertex> vertices;
 	vector<GLuint> indices;
 	vector<Texture> textures;
+	// When there are streams they are used instead of the interleaved vertices
+	vector<VertexStream> streams;
+	// Bounds in model space, setUpMesh computes them for the interleaved vertices,
+	// streamed meshes get them from their owner with setBounds
+	BoundingBox boundingBox;
+	BoundingSphere boundingSphere;
 
 	// Store VAO in public so it can be used in the Draw function
 	VAO VAO1;
+	// Interleaved vertices and indices, reused by every setUpMesh
+	VBO VBO1;
+	EBO EBO1;
+
+	// Bytes copied into this mesh by the setters and the copying constructor, moving costs nothing
+	size_t copiedBytes = 0;
 
 	// Initializes the mesh
 	Mesh(){};
-	Mesh(vector<Vertex> &vertices, vector<GLuint> &indices, vector<Texture> &textures);
-	void setVertices(vector<Vertex> _vertices) { vertices = _vertices; }
-	void setIndices(vector<GLuint> _indices) { indices = _indices; }
-	void setTextures(vector<Texture> _textures) { textures = _textures; }
+	// Copies the data, prefer moving it in with the other constructor
+	Mesh(const vector<Vertex> &vertices, const vector<GLuint> &indices, const vector<Texture> &textures);
+	Mesh(vector<Vertex> &&vertices, vector<GLuint> &&indices, vector<Texture> &&textures);
+	// The const& setters copy (and count the bytes), the && ones take the buffer
+	void setVertices(const vector<Vertex> &_vertices);
+	void setVertices(vector<Vertex> &&_vertices) { vertices = move(_vertices); }
+	void setIndices(const vector<GLuint> &_indices);
+	void setIndices(vector<GLuint> &&_indices) { indices = move(_indices); }
+	void setTextures(const vector<Texture> &_textures) { textures = _textures; }
+	void setTextures(vector<Texture> &&_textures) { textures = move(_textures); }
 	void setUpMesh();
+	// Adds a float attribute stream linked to layout, returns its index in streams
+	GLuint addStream(GLuint layout, GLuint numComponents);
+	vector<GLfloat> &streamData(GLuint stream) { return streams[stream].data; }
+	void markDirty(GLuint stream) { streams[stream].dirty = true; }
+	// Uploads only the streams that changed since the last upload
+	void updateStreams();
+	void setBounds(const BoundingBox &box);
 	// Draws the mesh
 	void Draw(Shader &shader);
+	// Deletes the VAO and every buffer of the mesh
+	void Delete();
+	// Material features of the shader variant this mesh needs (the lights are up to the scene)
+	ShaderFeatures getFeatures(ShaderFeatures lighting);
+
+private:
+	// Sampler uniforms of the textures, resolved once per shader
+	vector<Uniform<int>> textureUniforms;
+	GLuint texturesShader = 0;
+	void resolveTextureUniforms(Shader &shader);
 };
 #endif
\ No newline at end of file
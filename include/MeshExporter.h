@@ -0,0 +1,92 @@
+#ifndef MESH_EXPORTER_CLASS_H
+#define MESH_EXPORTER_CLASS_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+
+#include "Heightmap.h"
+
+using namespace std;
+
+// Samples the exporter reads, w x h starting at (x, y), clamped to the edges of the map
+struct HeightSource
+{
+    int width = 0, height = 0;
+    function<void(int x, int y, int w, int h, float *out)> read;
+
+    static HeightSource fromHeightmap(const Heightmap &map);
+    static HeightSource fromTiled(const TiledHeightmap &tiled, int level);
+};
+
+struct MeshExportOptions
+{
+    // Same meaning as in Terrain: X = col * distance, Y = 1 + sample * mapHeight, Z = row * distance
+    float distance = 0.1f;
+    float mapHeight = 3.5f;
+    // Samples per side of the blocks the map is walked in
+    int tileSize = 128;
+    // 16 bit positions and 8 bit normals (KHR_mesh_quantization for glTF)
+    bool quantize = false;
+};
+
+// Fixed size write buffer in front of a FILE
+class BufferedWriter
+{
+public:
+    BufferedWriter(size_t capacity = 1 << 20) : buffer(capacity) {}
+    ~BufferedWriter() { close(); }
+    bool open(const string &path);
+    void write(const void *data, size_t bytes);
+    bool close();
+    uint64_t getWritten() const { return written; }
+    size_t getCapacity() const { return buffer.size(); }
+
+private:
+    FILE *file = nullptr;
+    vector<char> buffer;
+    size_t used = 0;
+    uint64_t written = 0;
+    bool failed = false;
+    void flush();
+};
+
+// Writes the terrain surface as a mesh with shared vertices without building it in
+// memory, the vertices and then the triangles are streamed tile by tile, every
+// index is computed from the grid position, so only one tile (plus an apron of one
+// sample for the normals) is held at a time
+class MeshExporter
+{
+public:
+    // Binary little endian PLY
+    static bool writePLY(const string &path, const HeightSource &source, const MeshExportOptions &options);
+    // path.gltf plus path.bin next to it
+    static bool writeGLTF(const string &path, const HeightSource &source, const MeshExportOptions &options);
+
+    // Reads back a float PLY made by writePLY and counts the triangles whose face
+    // normal faces the other side than their vertex normals, false if the file can't be read
+    static bool checkWinding(const string &path, uint64_t &flipped);
+
+    // Bytes held by the last export besides the source, the same for any map size
+    static size_t getWorkingSet() { return workingSet; }
+
+private:
+    struct Bounds
+    {
+        float min[3], max[3];
+    };
+    static size_t workingSet;
+
+    static bool checkSize(const HeightSource &source);
+    static Bounds getBounds(const HeightSource &source, const MeshExportOptions &options);
+    // Vertex records of every sample, tile by tile, in the order the indices expect
+    static void writeVertices(BufferedWriter &out, const HeightSource &source, const MeshExportOptions &options, const Bounds &bounds);
+    // Two triangles per grid cell, prefix is written before every triangle (the PLY list count)
+    static void writeTriangles(BufferedWriter &out, const HeightSource &source, const MeshExportOptions &options, bool prefix);
+    // Index of the vertex of sample (x, y)
+    static uint32_t vertexIndex(const HeightSource &source, int tileSize, int x, int y);
+};
+
+#endif
@@ -10,6 +10,7 @@
 
 // #include "./Mesh.h"
 #include "./Mesh.h"
+#include "./ShaderVariants.h"
 
 using namespace std;
 
@@ -21,6 +22,11 @@ public:
 		loadModel(path);
 	}
 	void Draw(Shader &shader);
+	// Draws every mesh with the smallest variant for its material
+	void Draw(ShaderVariants &shaders, const ShaderFeatures &lighting);
+	// Bounds of all the meshes together, in model space
+	BoundingBox getBoundingBox();
+	BoundingSphere getBoundingSphere() { return BoundingSphere(getBoundingBox()); }
 	// model data
 	vector<Mesh> meshes;
 
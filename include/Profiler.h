@@ -0,0 +1,92 @@
+#ifndef PROFILER_CLASS_H
+#define PROFILER_CLASS_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "Trace.h"
+
+using namespace std;
+
+// Frames kept in the rolling history of every stage
+const int PROFILER_HISTORY = 120;
+// GPU results are read this many frames after they were issued, so reading them doesn't stall
+const int GPU_QUERY_FRAMES = 3;
+
+// A named section of the frame, the same name inside another parent is another stage
+struct ProfileStage
+{
+    string name;
+    int parent = -1; // index of the enclosing stage, -1 for the top level
+    int depth = 0;
+    bool gpu = false; // has been timed with GL_TIME_ELAPSED at least once
+
+    // Milliseconds per frame, indexed by frame % PROFILER_HISTORY
+    vector<float> cpuHistory = vector<float>(PROFILER_HISTORY, 0.0f);
+    vector<float> gpuHistory = vector<float>(PROFILER_HISTORY, 0.0f);
+    float cpuAvg = 0.0f, cpuMax = 0.0f;
+    float gpuAvg = 0.0f, gpuMax = 0.0f;
+
+    // Time spent in the stage this frame, a stage can be entered several times
+    float cpuFrame = 0.0f;
+    // Queries issued in each of the last GPU_QUERY_FRAMES frames
+    vector<GLuint> queries[GPU_QUERY_FRAMES];
+    unsigned int usedQueries[GPU_QUERY_FRAMES] = {};
+};
+
+// Per frame CPU and GPU timings of the nested stages of the render loop
+// Only the work between beginFrame and endFrame is recorded, the stages are
+// also sent to the trace while it's capturing. Main thread only, the workers use TraceScope
+class Profiler
+{
+public:
+    static bool enabled;
+
+    static void beginFrame();
+    static void endFrame();
+
+    // Opens a stage inside the current one, returns its index (-1 when not recording)
+    // GL_TIME_ELAPSED queries can't nest, so gpu is ignored inside another GPU stage
+    static int begin(const char *name, bool gpu, initializer_list<TraceArg> args = {});
+    static void end(int stage);
+
+    static const vector<ProfileStage> &getStages() { return stages; }
+    // Slot of the oldest sample in the histories, for plotting them in order
+    static int getHistoryOffset() { return (frame + 1) % PROFILER_HISTORY; }
+
+    static void Delete();
+
+private:
+    struct OpenStage
+    {
+        int stage;
+        chrono::steady_clock::time_point start;
+        bool gpuQuery;
+    };
+    static vector<ProfileStage> stages;
+    static vector<OpenStage> stack;
+    static unsigned int frame;
+    static bool recording;
+    static bool gpuActive;
+
+    static int findStage(const char *name, int parent);
+    static void collectQueries(ProfileStage &stage, int slot, unsigned int issuedFrame);
+};
+
+// Times the enclosing block as a profiler stage
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name, bool gpu = false, initializer_list<TraceArg> args = {})
+        : stage(Profiler::begin(name, gpu, args)) {}
+    ~ProfileScope() { Profiler::end(stage); }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    int stage;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SEED_BROWSER_CLASS_H
+#define SEED_BROWSER_CLASS_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "./Terrain.h"
+#include "./TileGenerator.h"
+
+using namespace std;
+
+// Candidates of a batch and samples per side of their thumbnails
+const int SEED_BROWSER_COUNT = 64;
+const int SEED_THUMBNAIL_SIDE = 128;
+
+// A candidate seed, the noise is written by a worker and the texture made on the main thread
+struct SeedThumbnail
+{
+    unsigned int seed = 0;
+    vector<float> noise;
+    // Set by the worker once noise is complete
+    atomic<bool> ready{false};
+    // 0 until uploaded
+    GLuint texture = 0;
+};
+
+// Generates low resolution versions of many random seeds on a pool of threads,
+// with the noise options of the terrain, to pick one without regenerating the full map
+// Every seed has its own TileGenerator, so the workers share nothing but the options
+class SeedBrowser
+{
+public:
+    ~SeedBrowser();
+
+    // Stops the previous batch and starts count new random seeds
+    void start(Terrain &terrain, int count = SEED_BROWSER_COUNT);
+    // The workers stop after the thumbnail they are making
+    void stop();
+    // Colors and uploads the thumbnails finished since the last call, needs the GL context
+    void upload(const vector<ColorBand> &palette);
+    // The palette changed, every thumbnail is uploaded again
+    void recolor();
+    // Deletes the textures
+    void Delete();
+
+    int size() { return (int)thumbnails.size(); }
+    const SeedThumbnail &getThumbnail(int i) { return *thumbnails[i]; }
+    int getFinished() { return finished; }
+    bool isRunning() { return finished < size(); }
+    // Thumbnails per second of the batch so far
+    float getThroughput();
+
+private:
+    vector<unique_ptr<SeedThumbnail>> thumbnails;
+    vector<thread> workers;
+    GenerationOptions options;
+    atomic<int> next{0}, finished{0};
+    atomic<bool> cancelled{false};
+    double startTime = 0.0;
+    // Set by the worker that finishes the last thumbnail
+    atomic<double> endTime{0.0};
+
+    void work();
+    static double now();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SHADER_CACHE_CLASS_H
+#define SHADER_CACHE_CLASS_H
+
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+// Folder where the linked programs are stored between runs
+const char *const SHADER_CACHE_DIR = "./shader_cache";
+
+// Disk cache of linked programs (glGetProgramBinary / glProgramBinary)
+// The entries are keyed by a hash of the sources and the driver, a stale entry
+// is just overwritten by the next compilation
+class ShaderCache
+{
+public:
+    // Hash of the sources together with the vendor, renderer and version strings
+    static uint64_t getKey(const string &vertexCode, const string &fragmentCode);
+
+    // Loads the program stored as name, returns false if it's missing, stale or
+    // the driver rejects it. compileMs is the compile time saved with the entry
+    static bool load(GLuint program, const string &name, uint64_t key, float &compileMs);
+    // Stores the linked program, compileMs is how long it took to build
+    static void save(GLuint program, const string &name, uint64_t key, float compileMs);
+
+    // Must be called before linking so the driver keeps the binary around
+    static void setRetrievable(GLuint program);
+    // The driver supports program binaries (GL 4.1 or ARB_get_program_binary)
+    static bool isSupported();
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SHADER_VARIANTS_CLASS_H
+#define SHADER_VARIANTS_CLASS_H
+
+#include <unordered_map>
+#include <functional>
+
+#include "shaderClass.h"
+
+// Builds the variants of a pair of shaders on demand and keeps them, so every
+// draw can use the smallest program that does the job
+class ShaderVariants
+{
+public:
+    ShaderVariants(const char *vertexFile, const char *fragmentFile);
+
+    // The variant with exactly these features, it's built the first time
+    Shader &get(const ShaderFeatures &features);
+    // Called once for each new variant to set its static uniforms
+    void setOnBuild(function<void(Shader &)> callback) { onBuild = callback; }
+
+    void Delete();
+
+private:
+    string vertexFile;
+    string fragmentFile;
+    // By ShaderFeatures::key
+    unordered_map<unsigned int, Shader> variants;
+    function<void(Shader &)> onBuild;
+};
+
+#endif
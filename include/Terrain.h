@@ -2,15 +2,63 @@
 #define TERRAIN_CLASS_H
 
 #include "./Mesh.h"
+#include "./UBO.h"
+#include "./BufferPool.h"
+#include "./Profiler.h"
 #include "./perlin.h"
+#include "./Heightmap.h"
+#include "./LRUCache.h"
+
+#include <memory>
+#include <future>
+#include <atomic>
+
+// Must match MAX_COLOR_BANDS in default.frag
+const int MAX_COLOR_BANDS = 8;
+// A grid point is shared by at most 4 vertices (one per quad around it)
+const int MAX_COMMON_VERT = 4;
+// Default memory for the results of recent options
+const size_t RESULT_CACHE_BUDGET = 256 << 20;
+// While an option is dragged, maps bigger than PREVIEW_MIN_DIMENSION take one
+// sample out of PREVIEW_STEP per side and are refined when it's released
+const int PREVIEW_STEP = 4;
+const int PREVIEW_MIN_DIMENSION = 256;
+
+// A band of the terrain palette, every noise value below the threshold takes this color
+// Laid out as a std140 vec4 (rgb + threshold)
+struct ColorBand
+{
+    glm::vec3 color;
+    float threshold;
+};
+
+// What the noise options produce, a cache hit copies it back and only uploads
+struct TerrainResult
+{
+    vector<GLfloat> heightmap, heights, normals;
+    float minNoise, maxNoise;
+
+    size_t getBytes() const { return (heightmap.size() + heights.size() + normals.size()) * sizeof(GLfloat); }
+    ~TerrainResult() { MemoryTracker::release(MEM_RESULT_CACHE, getBytes()); }
+};
 
 class Terrain
 {
 public:
     Terrain(int _width = 20, int _height = 20);
+    // The pool tracks the buffers by reference, a copy or a move would report the old ones
+    Terrain(const Terrain &) = delete;
+    Terrain &operator=(const Terrain &) = delete;
 
     void drawTerrain(Shader &shader);
-    void checkUpdate();
+    // Deletes the mesh buffers and the palette block
+    void Delete();
+    // Features of the variant to draw the terrain with the given lights
+    ShaderFeatures getFeatures(ShaderFeatures lighting) { return terrainMesh.getFeatures(lighting); }
+    // Applies the changed parameters, returns true if anything changed
+    bool checkUpdate();
+    // The full resolution noise of a preview is being made in the background
+    bool isRefining() { return refineTask.valid(); }
 
     void
     generateVertices();
@@ -18,9 +66,26 @@ public:
     void generateIndices();
     void generateNormals();
 
+    // Regenerates the terrain with a new random seed
     void resetSeed();
+    // The same seed and options always give the same terrain
+    void setSeed(unsigned int _seed);
+    // Copy of the noise values, (width + 1) x (height + 1) samples, waits for a refine
+    Heightmap getHeightmap();
+    // Uses the samples instead of the noise until the seed or the dimension changes
+    void loadHeightmap(Heightmap &&map);
+    // Replaces the noise of the current options with processed samples (erosion) of
+    // the same size, they last until the next regeneration and are never cached
+    void setNoise(const vector<GLfloat> &noise);
+    // Counts the regenerations, samples processed from an older one are stale
+    size_t getNoiseVersion() { return noiseVersion; }
+    bool isImported() { return !importedPos.empty(); }
     void resetOptions();
+    // Sizes the heightmap for the dimension, regenerate fills it
     void resetTerrain();
+    void resetColorBands();
+    // Uploads the palette to the ColorBands block, the vertices are not touched
+    void updateColorBands();
     // Setters
     void setWidth(int _width);
     void setHeight(int _height);
@@ -37,19 +102,94 @@ public:
     float getFrequency() { return frequency; }
     float getLacunarity() { return lacunarity; }
     float getMapHeight() { return mapHeight; }
+    unsigned int getSeed() { return perlin.getSeed(); }
+    const Mesh &getMesh() { return terrainMesh; }
+    // Bytes of buffers copied by the pipeline since resetCopiedBytes. Generating the
+    // noise copies nothing, the result cache, imported and refined maps and setNoise
+    // copy whole buffers, and so would filling the mesh through its copying setters
+    size_t getCopiedBytes() { return copiedBytes + terrainMesh.copiedBytes; }
+    void resetCopiedBytes() { copiedBytes = terrainMesh.copiedBytes = 0; }
+    // Memory kept between regenerations
+    const BufferPool &getPool() { return pool; }
+    // Results of recent seeds and options, going back to one of them skips the noise
+    const LRUCache<uint64_t, shared_ptr<const TerrainResult>> &getResultCache() { return resultCache; }
+    // 0 turns the cache off and frees it
+    void setCacheBudget(size_t bytes) { resultCache.setBudget(bytes); }
+    // Bounds of the terrain in model space
+    const BoundingBox &getBoundingBox() { return terrainMesh.boundingBox; }
+    const BoundingSphere &getBoundingSphere() { return terrainMesh.boundingSphere; }
+    // Height of the terrain surface at (x, z) in model space, for placing things on it
+    float getHeightAt(float x, float z);
 
-    vector<vector<GLfloat>> terrainPos;
+    // Heightmap with (height + 1) rows of (width + 1) noise values
+    vector<GLfloat> terrainPos;
+    // Palette ordered by threshold, the last band takes every remaining value
+    vector<ColorBand> colorBands;
 
 private:
-    void generateTerrain(vector<vector<GLfloat>> &positions);
+    // Noise, heights and normals for the current options, from the cache when it has them
+    void regenerate();
+    // Identifies the current seed and noise options for a mesh of keyWidth x keyHeight cells at a step
+    uint64_t getResultKey(int keyStep, int keyWidth, int keyHeight);
+    NoiseOptions getNoiseOptions();
+    void generateTerrain(vector<GLfloat> &positions);
+    // Noise of rows x columns samples taken every step samples of the full grid, split in
+    // bands over threads. Only reads its arguments, so it also runs off the main thread
+    static void generateNoise(const PerlinNoise &noise, const NoiseOptions &options, int step, int rows, int columns, int threads,
+                              GLfloat *positions, float &minNoise, float &maxNoise, const atomic<bool> &cancel);
+    // The rows [firstRow, lastRow) of generateNoise
+    static void generateRows(const PerlinNoise &noise, const NoiseOptions &options, int step, int columns, GLfloat *positions,
+                             int firstRow, int lastRow, float &rowsMin, float &rowsMax, const atomic<bool> &cancel);
+    // Rebuilds the mesh with one vertex every _step samples of the full grid
+    void setStep(int _step);
+    // Cells per side of the mesh at the current step
+    int meshSide() { return (dimension + step - 1) / step; }
+    // Makes the full resolution noise of the current options in the background
+    void startRefine();
+    // Waits for the background noise and builds the mesh with it, or throws it away
+    void finishRefine(bool cancel);
+    // Recomputes the mesh bounds from the noise range and the current scale
+    void updateBounds();
+    // Index of the grid point in terrainPos and commonCount
+    int gridIndex(int posz, int posx) { return posz * (width + 1) + posx; }
+    void addCommonVert(int posz, int posx, GLuint vert)
+    {
+        int point = gridIndex(posz, posx);
+        commonVert[MAX_COMMON_VERT * point + commonCount[point]++] = vert;
+    }
     glm::vec3 getNormalVector(glm::vec3 vert1, glm::vec3 vert2, glm::vec3 vert3);
-    glm::vec3 getColor(float noise);
 
 private:
-    vector<vector<vector<GLuint>>> commonVert;
+    vector<GLuint> commonVert;
+    vector<GLubyte> commonCount;
+    BufferPool pool;
+    PerlinNoise perlin;
+    // Heightmap given to loadHeightmap, replaces the noise while it's not empty
+    vector<GLfloat> importedPos;
+    LRUCache<uint64_t, shared_ptr<const TerrainResult>> resultCache{RESULT_CACHE_BUDGET};
+    // Grid samples between two vertices of the mesh, 1 is full resolution
+    int step = 1;
+    // Background noise of the refine, only touched by the main thread once it's done
+    // The task is declared after refineCancel and refinedPos, the ones it uses, so it's
+    // destroyed (and waited for) before them
+    atomic<bool> refineCancel{false};
+    vector<GLfloat> refinedPos;
+    future<void> refineTask;
+    // generateTerrain takes refinedPos instead of making the noise
+    bool refined = false;
+    size_t noiseVersion = 0;
 
     // Mesh
     Mesh terrainMesh;
+    // Indices of the attribute streams of the mesh
+    GLuint gridStream, normalStream, heightStream;
+    size_t copiedBytes = 0;
+    // Scale uniforms of the last shader used to draw
+    Uniform<float> mapHeightUniform, gridDistanceUniform;
+    GLuint uniformsShader = 0;
+    // Range of the heightmap
+    float minNoise = 0.0f, maxNoise = 0.0f;
+    UBO colorBandsUBO;
 
 public:
     int width;
@@ -65,7 +205,10 @@ public:
     float lastFreq, lastLacuranity, lastPersistance, lastScale, lastDistance, lastMapHeight;
     int lastWidth, lastHeight, lastDimension, lastLayers;
 
-    bool seed;
+    // Threads used for the noise, the result is the same for any count
+    int threads;
+    // An option is being dragged, big maps are regenerated as a coarse preview
+    bool preview = false;
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "stb_image.h"
 
 #include "shaderClass.h"
+#include "MemoryTracker.h"
 
 class Texture
 {
@@ -13,6 +14,8 @@ public:
 	string type;
 	GLuint unit;
 	std::string path;
+	// Bytes of the image and its mipmaps on the GPU
+	size_t size = 0;
 	Texture(const char *image, const char *texType, GLuint slot, GLenum format, GLenum pixelType);
 
 	// Assigns a texture unit to a texture
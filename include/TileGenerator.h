@@ -0,0 +1,50 @@
+#ifndef TILE_GENERATOR_CLASS_H
+#define TILE_GENERATOR_CLASS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "perlin.h"
+
+using namespace std;
+
+// Everything the heights of a map depend on
+struct GenerationOptions
+{
+    unsigned int seed = 0;
+    // Samples per side, the map matches Terrain at dimension size - 1
+    int size = 1025;
+    int layers = 1;
+    float frequency = 1.0f, persistance = 0.5f, lacunarity = 2.0f;
+    // Same meaning as in Terrain, only used for the normals
+    float distance = 0.1f;
+    float mapHeight = 3.5f;
+
+    // Identifies the output, a checkpoint is only resumed with the same hash
+    uint64_t hash() const;
+};
+
+// Generates any part of a map without the rest of it, every sample only depends
+// on its position, so the tiles can be made in any order, on any thread or process
+class TileGenerator
+{
+public:
+    TileGenerator(const GenerationOptions &options);
+
+    // w x h heights starting at (x, y), the positions past the edges are clamped
+    void generateRegion(int x, int y, int w, int h, float *out) const;
+    // Heights of tile (tx, ty), tileSize x tileSize, padded past the edge of the map
+    void generateTile(int tx, int ty, int tileSize, float *heights) const;
+    // Normals of the same tile packed as TILE_NORMAL_RGBA8, scratch holds the apron of one sample
+    void generateNormals(int tx, int ty, int tileSize, uint32_t *normals, vector<float> &scratch) const;
+
+    const GenerationOptions &getOptions() const { return options; }
+
+private:
+    GenerationOptions options;
+    NoiseOptions noise;
+    PerlinNoise perlin;
+};
+
+#endif
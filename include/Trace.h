@@ -0,0 +1,73 @@
+#ifndef TRACE_CLASS_H
+#define TRACE_CLASS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <ostream>
+
+using namespace std;
+
+// Events kept before the capture stops recording, about 100 bytes each
+const size_t TRACE_MAX_EVENTS = 1000000;
+
+// Numeric argument shown with an event (grid size, octaves...), the key must be a literal
+typedef pair<const char *, double> TraceArg;
+
+// Opt-in capture of begin/end events in the Chrome trace format, the file
+// can be opened in chrome://tracing or ui.perfetto.dev
+// Every call is thread safe, each thread shows as its own track
+class Trace
+{
+public:
+    static void start(const string &path);
+    // Writes the captured events to the file given to start
+    static void stop();
+    static bool isEnabled() { return enabled; }
+
+    static void begin(const char *name, initializer_list<TraceArg> args = {});
+    static void end();
+    // Label of the calling thread in the viewer
+    static void setThreadName(const string &name);
+
+    static size_t getEventCount();
+
+private:
+    struct Event
+    {
+        string name;
+        char phase = 'B';
+        double timestamp = 0.0; // microseconds since start
+        int thread = 0;
+        vector<TraceArg> args = {};
+        string label = ""; // thread name of the metadata events
+    };
+    static atomic<bool> enabled;
+    static string path;
+    static vector<Event> events;
+    static size_t dropped;
+    static mutex eventsMutex;
+    static chrono::steady_clock::time_point startTime;
+
+    static int threadId();
+    static int &threadDepth();
+    static void push(Event &&event);
+    // Quoted JSON string, the names can come from the command line
+    static void writeString(ostream &out, const string &text);
+};
+
+// Traces the enclosing block
+class TraceScope
+{
+public:
+    TraceScope(const char *name, initializer_list<TraceArg> args = {}) { Trace::begin(name, args); }
+    ~TraceScope() { Trace::end(); }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef UBO_CLASS_H
+#define UBO_CLASS_H
+
+#include <glad/glad.h>
+
+#include "MemoryTracker.h"
+
+// Binding points of the uniform blocks, every Shader links them when it's built
+const GLuint COLOR_BANDS_BINDING = 0;
+const GLuint CAMERA_BINDING = 1;
+const GLuint LIGHTS_BINDING = 2;
+
+class UBO
+{
+public:
+    GLuint ID;
+    // Binding point shared by every program that declares the block
+    GLuint binding;
+    GLsizeiptr size;
+    UBO(GLsizeiptr size, GLuint binding);
+
+    // Writes the data to the buffer starting at offset
+    void update(const void *data, GLsizeiptr size, GLintptr offset = 0);
+    void Bind();
+    void Unbind();
+    void Delete();
+};
+
+#endif
@@ -5,13 +5,14 @@
 #include <glad/glad.h>
 #include <vector>
 
+#include "MemoryTracker.h"
+
 using namespace std;
 
 struct Vertex
 {
     glm::vec3 position;
     glm::vec3 normal;
-    glm::vec3 color;
     glm::vec2 texCoords;
 };
 
@@ -19,7 +20,15 @@ class VBO
 {
 public:
     GLuint ID;
+    // Bytes given to the driver by the last upload
+    GLsizeiptr size = 0;
     VBO(vector<Vertex> &vertices);
+    // Generates an empty buffer, filled later with update
+    VBO();
+
+    // Replaces the content of the buffer
+    void update(vector<GLfloat> &data);
+    void update(vector<Vertex> &vertices);
 
     void Bind();
     void Unbind();
@@ -34,6 +34,15 @@ const glm::vec3 CAMERA_POSITION_DEFAULT(0.0f, 0.0f, 3.0f);
 const glm::vec3 CAMERA_TARGET_DEFAULT(0.0f, 0.0f, 0.0f);
 const glm::mat4 CAMERA_MATRIX_DEFAULT(1.0f);
 
+// Content of the Camera uniform block (std140)
+struct CameraBlock
+{
+    glm::mat4 camMatrix;
+    glm::vec3 camPos;
+    float pad;
+};
+static_assert(sizeof(CameraBlock) == 80, "CameraBlock must follow the std140 layout");
+
 class Camera
 {
 private:
@@ -46,11 +55,17 @@ public:
     Camera(int width, int height);
     void setLocation(glm::vec3 pos, glm::vec3 front, float yawAngle, float pitchAngle);
     void getMatrix(Shader &shader, const char *uniform);
-    void updateMatrix();
+    void getMatrix(const Uniform<glm::mat4> &uniform);
+    // Exports the matrix and the position to the Camera block in a single write
+    void getMatrix(UBO &cameraUBO);
+    // Returns true if the camera moved since the last update
+    bool updateMatrix();
     void processInput(GLFWwindow *window, float deltaTime);
     void processMouseScroll(float yoffset);
     void updateDeltaTime(float deltaTime);
     void updateViewport(int width, int height);
+    float getYaw() const { return yaw; }
+    float getPitch() const { return pitch; }
 
     // Camera vectors
     glm::vec3 cameraPos;
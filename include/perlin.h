@@ -8,7 +8,7 @@ Perlin Noise Algorithm for Height Map
 #include <vector>
 #include <cmath>
 #include <algorithm>
-#include <ctime>
+#include <random>
 
 using namespace std;
 
@@ -35,12 +35,6 @@ private:
     float first, second;
 };
 
-void random(vector<int> &V);
-
-void fillPermutation(vector<int> &table);
-
-void setUp();
-
 Vector2D getGradient(int value);
 
 // Linear interpolation , also know as lerp
@@ -48,6 +42,33 @@ float lerp(float a, float b, float t);
 
 float fade(float t);
 
-float perlinNoise(float x, float y);
+// Octaves summed by PerlinNoise::fractal, the same parameters as the Terrain sliders
+struct NoiseOptions
+{
+    int layers = 1;
+    float frequency = 1.0f, persistance = 0.5f, lacunarity = 2.0f;
+    // Samples per wave of frequency 1
+    int dimension = 1;
+};
+
+// The permutation table comes from the seed alone (mt19937 is the same everywhere),
+// so a seed always gives the same terrain. noise() only reads the table and can
+// be called from several threads
+class PerlinNoise
+{
+public:
+    PerlinNoise(unsigned int seed = 0);
+
+    float noise(float x, float y) const;
+    // Height of grid sample (row, col) in [0, 1], only depends on the position,
+    // so any part of the map can be generated on its own
+    float fractal(const NoiseOptions &options, int row, int col) const;
+    unsigned int getSeed() const { return seed; }
+
+private:
+    unsigned int seed;
+    // 256 shuffled values repeated twice, so PT[PT[X] + Y + 1] stays in range
+    int PT[512];
+};
 
 #endif
\ No newline at end of file
@@ -2,10 +2,12 @@
 #define SHADER_CLASS_H
 
 #include <glad/glad.h>
+#include "./UBO.h"
 #include "./glm/glm.hpp"
 #include "./glm/gtc/matrix_transform.hpp"
 #include "./glm/gtc/type_ptr.hpp"
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <iostream>
 #include <cerrno>
@@ -14,15 +16,66 @@ using namespace std;
 
 string getFileContents(const char *filename);
 
+// Sets a uniform of the active program by location
+void setUniform(GLint location, bool value);
+void setUniform(GLint location, int value);
+void setUniform(GLint location, float value);
+void setUniform(GLint location, const glm::vec2 &value);
+void setUniform(GLint location, const glm::vec3 &value);
+void setUniform(GLint location, const glm::vec4 &value);
+void setUniform(GLint location, const glm::mat2 &mat);
+void setUniform(GLint location, const glm::mat3 &mat);
+void setUniform(GLint location, const glm::mat4 &mat);
+
+// Features compiled into a variant of the default shaders (see default.frag)
+struct ShaderFeatures
+{
+    // Point lights evaluated, up to NR_POINT_LIGHTS
+    int pointLights = 0;
+    bool spotLight = false;
+    // Material samplers
+    bool textures = false;
+    // ColorBands palette instead of the diffuse texture
+    bool terrainColors = true;
+
+    // #define lines inserted after the #version of the sources
+    string defines() const;
+    // Short name of the variant Ex: p0_s0_t0_c1
+    string name() const;
+    // Packed features, to look the variants up without strings
+    unsigned int key() const { return pointLights | spotLight << 8 | textures << 9 | terrainColors << 10; }
+};
+
+// Typed handle of a uniform, the location is looked up once so setting it
+// every frame doesn't touch any string nor the driver
+template <typename T>
+class Uniform
+{
+public:
+    GLint location;
+    Uniform(GLint _location = -1) : location(_location){};
+
+    // The program must be active
+    void set(const T &value) const { setUniform(location, value); }
+};
+
 class Shader
 {
 public:
     GLuint ID;
     // Constructor that build the Shader Program from 2 different Shaders
     Shader(const char *vertexFile, const char *fragmentFile);
+    // Builds the variant of the shaders specialized for the features
+    Shader(const char *vertexFile, const char *fragmentFile, const ShaderFeatures &features);
 
     void Activate();
     void Delete();
+
+    // Location from the cache filled at link time, -1 if the program doesn't use it
+    GLint getUniformLocation(const std::string &name) const;
+    template <typename T>
+    Uniform<T> getUniform(const std::string &name) const { return Uniform<T>(getUniformLocation(name)); }
+
     // Utility Uniform functions
     // ------------------------
     void setBool(const std::string &name, bool value) const;
@@ -37,10 +90,21 @@ public:
     void setMat2(const std::string &name, const glm::mat2 &mat) const;
     void setMat3(const std::string &name, const glm::mat3 &mat) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    // Links a uniform block of the program to a UBO binding point
+    void bindUniformBlock(const char *blockName, GLuint binding) const;
 
 private:
+    // Locations of the active uniforms by name
+    unordered_map<string, GLint> uniformLocations;
+
     // Check if the different shaders have compiled properly
     void compileErrors(unsigned int shader, const char *type);
+    // Compiles and links the program, or loads it from the ShaderCache
+    void build(const string &vertexCode, const string &fragmentCode, const string &cacheName);
+    // Uniform cache and shared blocks of the linked program
+    void setUpProgram();
+    // Queries all the active uniforms of the linked program
+    void cacheUniforms();
 };
 
 #endif
\ No newline at end of file
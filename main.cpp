@@ -5,30 +5,51 @@
 #include "./imgui/imgui_impl_glfw.h"
 #include "./imgui/imgui_impl_opengl3.h"
 #include "./include/Terrain.h"
+#include "./include/Lights.h"
+#include "./include/ShaderVariants.h"
+#include "./include/InteractionRecorder.h"
+#include "./include/GoldenCheck.h"
+#include "./include/MeshExporter.h"
+#include "./include/SeedBrowser.h"
+#include "./include/Erosion.h"
+
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void input_callback(GLFWwindow *window);
+void refresh_callback(GLFWwindow *window);
 void processInput(GLFWwindow *window);
 
 const unsigned int SCR_WIDTH = 600;
 const unsigned int SCR_HEIGHT = 600;
 const unsigned int sceneN = 150;
 const unsigned int sceneM = 150;
+// Tiles of the exported .hmt files and largest side imported into the mesh
+const int HEIGHTMAP_TILE_SIZE = 64;
+const int MAX_IMPORT_SIDE = 1025;
 
 float lastFrame = glfwGetTime();
 float deltaTime = 0;
 
-Camera camera(SCR_WIDTH, SCR_HEIGHT);
-
-struct DirLight
+// Render on demand: when nothing changed the loop sleeps until an event arrives
+struct RenderSettings
 {
-    glm::vec3 direction;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+    bool onDemand = true;
+    int maxFPS = 60;          // frame rate cap, 0 means uncapped
+    float minRefresh = 1.0f;  // seconds between redraws while idle
 };
+RenderSettings renderSettings;
+// ImGui needs a couple of frames to settle after an input (hover, popups...)
+const int SETTLE_FRAMES = 3;
+int pendingFrames = SETTLE_FRAMES;
+// A camera step is never longer than this, so the first frame after sleeping doesn't jump
+const float MAX_FRAME_TIME = 0.1f;
+
+Camera camera(SCR_WIDTH, SCR_HEIGHT);
 
 int main()
 {
@@ -60,6 +81,16 @@ int main()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     // Callback for scroll events
     glfwSetScrollCallback(window, scroll_callback);
+    // Any input or expose wakes the render loop (ImGui chains these callbacks)
+    glfwSetCursorPosCallback(window, [](GLFWwindow *window, double, double)
+                             { input_callback(window); });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow *window, int, int, int)
+                               { input_callback(window); });
+    glfwSetKeyCallback(window, [](GLFWwindow *window, int, int, int, int)
+                       { input_callback(window); });
+    glfwSetCharCallback(window, [](GLFWwindow *window, unsigned int)
+                        { input_callback(window); });
+    glfwSetWindowRefreshCallback(window, refresh_callback);
 
     // load GLAD to get the pointers functions of OpenGL, respect to the current OS
     gladLoadGL();
@@ -67,35 +98,60 @@ int main()
     // Specify the viewport
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
-    // Creates Shader object using shaders default.vert and default.frag
-    Shader shaderProgram("./shaders/default.vert", "./shaders/default.frag");
+    // Opt-in trace of the whole run: TERRAIN_TRACE=trace.json ./app
+    if (getenv("TERRAIN_TRACE"))
+    {
+        Trace::start(getenv("TERRAIN_TRACE"));
+        Trace::setThreadName("main");
+    }
+
+    // Variants of default.vert and default.frag, built the first time a draw needs them
+    ShaderVariants shaders("./shaders/default.vert", "./shaders/default.frag");
 
     Terrain plane(sceneM, sceneN);
 
-    shaderProgram.Activate();
-    float scaleFactor = 1.0f;
-    shaderProgram.setFloat("scale", scaleFactor);
+    // Golden output checks, the app exits with the result
+    if (getenv("TERRAIN_BLESS") || getenv("TERRAIN_VERIFY"))
+    {
+        int failures = getenv("TERRAIN_BLESS") ? !GoldenCheck::bless(plane, getenv("TERRAIN_BLESS"))
+                                               : GoldenCheck::verify(plane, getenv("TERRAIN_VERIFY"), cout);
+        plane.Delete();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return failures ? 1 : 0;
+    }
+
+    // Per frame data shared by every program, written once per frame
+    UBO cameraUBO(sizeof(CameraBlock), CAMERA_BINDING);
+    UBO lightsUBO(sizeof(LightsBlock), LIGHTS_BINDING);
 
+    float scaleFactor = 1.0f;
     // The ModelMatrix
     glm::mat4 boxModel = glm::mat4(1.0f);
-    shaderProgram.setMat4("model", boxModel);
 
     //---------------Setting directional light in the scene---------------//
-    DirLight dirLight;
+    // The point and spot lights stay off (zeroed) until the shader uses them
+    LightsBlock lights = {};
+    DirLight &dirLight = lights.dirLight;
     dirLight.direction = glm::vec3(-0.2f, 0.2f, 0.6f);
     dirLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
     dirLight.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
     dirLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
 
-    shaderProgram.setVec3("dirLight.direction", dirLight.direction);
-    shaderProgram.setVec3("dirLight.ambient", dirLight.ambient);
-    shaderProgram.setVec3("dirLight.diffuse", dirLight.diffuse);
-    shaderProgram.setVec3("dirLight.specular", dirLight.specular);
-
-    // material settings
-    shaderProgram.setFloat("material.shininess", 16.0f);
+    // Lights evaluated by the shaders, only the directional light is on
+    ShaderFeatures lighting;
+    lighting.pointLights = 0;
+    lighting.spotLight = false;
     //---------------Setting directional light in the scene---------------//
 
+    // Uniforms that don't change, set on every variant when it's built
+    shaders.setOnBuild([scaleFactor, boxModel](Shader &shader)
+                       {
+                           shader.setFloat("scale", scaleFactor);
+                           shader.setMat4("model", boxModel);
+                           // material settings
+                           shader.setFloat("material.shininess", 16.0f); });
+
     glEnable(GL_DEPTH_TEST);
 
     // Precalculated Values to get a good point of view
@@ -114,10 +170,55 @@ int main()
     ImGui_ImplOpenGL3_Init("#version 330");
 
     bool drawTerrain = true;
-    GLuint counter;
+    bool quantizeMesh = false;
+    int resultCacheMB = RESULT_CACHE_BUDGET >> 20;
+    // Low resolution candidates of random seeds, made off the main thread
+    SeedBrowser seedBrowser;
+    // Droplet erosion of the current noise, run in the background with a preview per batch
+    ErosionTask erosion;
+    ErosionOptions erosionOptions;
+    int erosionDropletsK = erosionOptions.droplets / 1000;
+    // Thermal erosion of the cliffs steeper than the talus angle (degrees, in world space)
+    ThermalOptions thermalOptions;
+    float talusAngle = 30.0f;
+    const char *erosionUnit = "droplets";
+    // Regeneration the erosion started from, its heights don't apply to another one
+    size_t erodedVersion = 0;
+    vector<float> erodedNoise;
+    GLuint counter = 0;
+
+    // Records the session to interaction.txt and replays it measuring the latency
+    InteractionRecorder recorder;
+    bool replayReport = false;
+
+    float lastFrameStart = glfwGetTime();
+    unsigned int drawnFrames = 0, skippedWaits = 0;
+
     // render loop
     while (!glfwWindowShouldClose(window))
     {
+        // Nothing changed since the last frames, sleep until an event, the refresh
+        // interval or the next replayed change
+        if (renderSettings.onDemand && pendingFrames <= 0 && !recorder.isBusy())
+        {
+            glfwWaitEventsTimeout(min((double)renderSettings.minRefresh, recorder.timeToNextEvent(glfwGetTime())));
+            skippedWaits++;
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+        if (pendingFrames > 0)
+            pendingFrames--;
+
+        Profiler::beginFrame();
+        int frameStage = Profiler::begin("Frame", false);
+
+        float frameStart = glfwGetTime();
+        float frameTime = min(frameStart - lastFrameStart, MAX_FRAME_TIME);
+        lastFrameStart = frameStart;
+        drawnFrames++;
+
         processInput(window);
 
         // Specify the color of the background
@@ -138,22 +239,23 @@ int main()
             lastFrame = currentFrame;
             counter = 0;
         }
-        camera.processInput(window, deltaTime);
-        camera.updateMatrix();
+        if (recorder.replay(glfwGetTime(), plane, camera))
+            pendingFrames = SETTLE_FRAMES;
+        camera.processInput(window, frameTime);
+        // Keep drawing while the camera moves (held keys send no new events)
+        if (camera.updateMatrix())
+            pendingFrames = SETTLE_FRAMES;
 
         // New Frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        // Tells OpenGL which Shader Program we want to use
-        // Activate the shader before exporting uniforms
-        shaderProgram.Activate();
-
-        // Exports the camera Position to the Fragment Shader for specular lighting
-        shaderProgram.setVec3("camPos", camera.cameraPos);
-
-        camera.getMatrix(shaderProgram, "camMatrix");
+        // Exports the camera matrix and position (for specular lighting) to the Camera block
+        {
+            ProfileScope scope("Upload", true);
+            camera.getMatrix(cameraUBO);
+        }
 
         // ImGui::Begin("My name is window, ImGui window");
         // ImGui::Text("Hi Mom!");
@@ -165,14 +267,25 @@ int main()
         ImGui::SliderFloat3("Light Position", &dirLight.direction.x, -1.0f, 1.f);
         ImGui::End();
 
-        shaderProgram.setVec3("dirLight.direction", dirLight.direction);
-        shaderProgram.setVec3("dirLight.specular", dirLight.specular);
+        {
+            ProfileScope scope("Upload", true);
+            lightsUBO.update(&lights, sizeof(lights));
+        }
 
         ImGui::Begin("Terrain Options");
+        // While a noise slider is dragged the terrain is a coarse preview, refined once it's released
+        bool dragging = false;
         ImGui::SliderInt("Layers", &plane.layers, 1, 8);
+        dragging |= ImGui::IsItemActive();
         ImGui::SliderFloat("Frequency", &plane.frequency, 1.0f, 10.0f);
+        dragging |= ImGui::IsItemActive();
         ImGui::SliderFloat("Persistance", &plane.persistance, 0.1f, 1.0f);
+        dragging |= ImGui::IsItemActive();
         ImGui::SliderFloat("Lacunarity", &plane.lacunarity, 1.0f, 3.0f);
+        dragging |= ImGui::IsItemActive();
+        // A replay sets the preview from the recording
+        if (recorder.getMode() != InteractionRecorder::REPLAYING)
+            plane.preview = dragging;
         ImGui::SliderFloat("Map Height", &plane.mapHeight, 0.0f, 15.0f);
         ImGui::InputFloat("Distance", &plane.distance, 0.01f);
         ImGui::InputInt("Dimension", &plane.dimension, 1);
@@ -181,28 +294,311 @@ int main()
         {
             plane.resetSeed();
         }
+        // Typing a seed back reproduces its terrain
+        unsigned int seed = plane.getSeed();
+        if (ImGui::InputScalar("Seed", ImGuiDataType_U32, &seed, NULL, NULL, "%u", ImGuiInputTextFlags_EnterReturnsTrue))
+        {
+            plane.setSeed(seed);
+        }
+        ImGui::SliderInt("Threads", &plane.threads, 1, 16);
+        if (plane.isRefining())
+            ImGui::Text("Refining...");
+        const BufferPool &pool = plane.getPool();
+        ImGui::Text("Scratch: %.1f / %.1f KB (%zu grows)", pool.usedBytes() / 1024.0f, pool.reservedBytes() / 1024.0f, pool.getAllocations());
+        ImGui::End();
+
+        ImGui::Begin("Heightmap");
+        if (plane.isImported())
+            ImGui::Text("Imported %d x %d, the noise options are off", plane.getWidth() + 1, plane.getheight() + 1);
+        if (ImGui::Button("Export .r32", ImVec2(100, 30)))
+            HeightmapIO::saveRaw32("heightmap.r32", plane.getHeightmap());
+        ImGui::SameLine();
+        if (ImGui::Button("Export .r16", ImVec2(100, 30)))
+            HeightmapIO::saveRaw16("heightmap.r16", plane.getHeightmap());
+        ImGui::SameLine();
+        if (ImGui::Button("Export tiled", ImVec2(100, 30)))
+            TiledHeightmapWriter::write("heightmap.hmt", plane.getHeightmap(), HEIGHTMAP_TILE_SIZE);
+        // The mesh is streamed from the heightmap with the current scale
+        MeshExportOptions meshOptions;
+        meshOptions.distance = plane.distance;
+        meshOptions.mapHeight = plane.mapHeight;
+        meshOptions.quantize = quantizeMesh;
+        if (ImGui::Button("Export .ply", ImVec2(100, 30)))
+        {
+            Heightmap map = plane.getHeightmap();
+            MeshExporter::writePLY("terrain.ply", HeightSource::fromHeightmap(map), meshOptions);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export .gltf", ImVec2(100, 30)))
+        {
+            Heightmap map = plane.getHeightmap();
+            MeshExporter::writeGLTF("terrain.gltf", HeightSource::fromHeightmap(map), meshOptions);
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Quantize", &quantizeMesh);
+        Heightmap imported;
+        if (ImGui::Button("Import .r32", ImVec2(100, 30)) && HeightmapIO::loadRaw32("heightmap.r32", imported))
+            plane.loadHeightmap(move(imported));
+        ImGui::SameLine();
+        if (ImGui::Button("Import .r16", ImVec2(100, 30)) && HeightmapIO::loadRaw16("heightmap.r16", imported))
+            plane.loadHeightmap(move(imported));
+        ImGui::SameLine();
+        if (ImGui::Button("Import tiled", ImVec2(100, 30)))
+        {
+            // Big maps come in at the finest mip level the mesh can take
+            TiledHeightmap tiled;
+            if (tiled.open("heightmap.hmt") && tiled.getHeader().format == TILE_FLOAT32)
+                plane.loadHeightmap(tiled.readLevel(tiled.levelFor(MAX_IMPORT_SIDE)));
+        }
+        ImGui::End();
+
+        ImGui::Begin("Memory");
+        ImGui::Text("%-12s %10s %10s %7s %5s", "", "current KB", "peak KB", "allocs", "live");
+        for (int i = 0; i < MEM_TAG_COUNT; i++)
+        {
+            MemoryStats stat = MemoryTracker::get((MemoryTag)i);
+            ImGui::Text("%-12s %10.1f %10.1f %7zu %5ld", MemoryTracker::getName((MemoryTag)i), stat.current / 1024.0f, stat.peak / 1024.0f, stat.allocations, stat.live);
+        }
+        // Going back to recent options copies their result instead of regenerating it
+        if (ImGui::SliderInt("Result cache (MB)", &resultCacheMB, 0, 2048))
+            plane.setCacheBudget((size_t)resultCacheMB << 20);
+        const auto &resultCache = plane.getResultCache();
+        ImGui::Text("%zu results, %.1f MB, %zu hits, %zu misses", resultCache.size(), resultCache.getBytes() / 1048576.0f, resultCache.getHits(), resultCache.getMisses());
+        ImGui::End();
+
+        ImGui::Begin("Terrain Colors");
+        bool paletteChanged = false;
+        for (unsigned int i = 0; i < plane.colorBands.size(); i++)
+        {
+            ImGui::PushID(i);
+            paletteChanged |= ImGui::ColorEdit3("Color", &plane.colorBands[i].color.x);
+            paletteChanged |= ImGui::SliderFloat("Threshold", &plane.colorBands[i].threshold, 0.0f, 1.0f);
+            ImGui::PopID();
+        }
+        if (ImGui::Button("Reset Colors", ImVec2(100, 30)))
+        {
+            plane.resetColorBands();
+            paletteChanged = true;
+        }
+        // Only the palette buffer is uploaded, the vertices stay the same
+        else if (paletteChanged)
+        {
+            ProfileScope scope("Upload", true);
+            plane.updateColorBands();
+        }
         ImGui::End();
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        ImGui::Begin("Seed Browser");
+        if (ImGui::Button("Browse Seeds", ImVec2(100, 30)))
+            seedBrowser.start(plane);
+        if (paletteChanged)
+            seedBrowser.recolor();
+        // The thumbnails show up as the workers finish them, clicking one generates it in full
+        seedBrowser.upload(plane.colorBands);
+        if (seedBrowser.size() > 0)
+            ImGui::Text("%d / %d seeds, %.1f per second", seedBrowser.getFinished(), seedBrowser.size(), seedBrowser.getThroughput());
+        for (int i = 0; i < seedBrowser.size(); i++)
+        {
+            const SeedThumbnail &thumbnail = seedBrowser.getThumbnail(i);
+            if (i % 8 != 0)
+                ImGui::SameLine();
+            ImGui::PushID(i);
+            if (!thumbnail.texture)
+                ImGui::Button("...", ImVec2(50, 50));
+            else if (ImGui::ImageButton((ImTextureID)(intptr_t)thumbnail.texture, ImVec2(48, 48), ImVec2(0, 0), ImVec2(1, 1), 1))
+                plane.setSeed(thumbnail.seed);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Seed %u", thumbnail.seed);
+            ImGui::PopID();
+        }
+        ImGui::End();
+
+        ImGui::Begin("Erosion");
+        ImGui::SliderInt("Droplets (K)", &erosionDropletsK, 10, 5000);
+        ImGui::SliderInt("Lifetime", &erosionOptions.lifetime, 1, 100);
+        ImGui::SliderInt("Radius", &erosionOptions.radius, 0, 8);
+        ImGui::SliderFloat("Inertia", &erosionOptions.inertia, 0.0f, 1.0f);
+        ImGui::SliderFloat("Capacity", &erosionOptions.capacity, 0.5f, 16.0f);
+        ImGui::SliderFloat("Erode speed", &erosionOptions.erodeSpeed, 0.0f, 1.0f);
+        ImGui::SliderFloat("Deposit speed", &erosionOptions.depositSpeed, 0.0f, 1.0f);
+        ImGui::SliderFloat("Evaporate speed", &erosionOptions.evaporateSpeed, 0.0f, 0.1f);
+        ImGui::Separator();
+        ImGui::SliderFloat("Talus angle", &talusAngle, 1.0f, 89.0f);
+        ImGui::SliderFloat("Thermal rate", &thermalOptions.rate, 0.05f, 1.0f);
+        ImGui::SliderInt("Iterations", &thermalOptions.iterations, 1, 2000);
+        if (erosion.isRunning())
+        {
+            if (ImGui::Button("Stop", ImVec2(100, 30)))
+                erosion.stop();
+        }
+        else
+        {
+            bool startHydraulic = ImGui::Button("Erode", ImVec2(100, 30));
+            ImGui::SameLine();
+            bool startThermal = ImGui::Button("Smooth Cliffs", ImVec2(100, 30));
+            if (startHydraulic || startThermal)
+            {
+                // Starts from what is on screen, running it again erodes it further
+                Heightmap map = plane.getHeightmap();
+                int threads = plane.threads;
+                if (startHydraulic)
+                {
+                    erosionOptions.seed = plane.getSeed();
+                    erosionOptions.droplets = erosionDropletsK * 1000;
+                    auto hydraulic = make_shared<HydraulicErosion>(map.width, map.height, erosionOptions);
+                    erosion.start(map.samples, erosionOptions.droplets, [hydraulic, threads](vector<float> &heights, size_t limit)
+                                  { return (size_t)hydraulic->runBatch(heights.data(), (int)min(limit, (size_t)hydraulic->getOptions().batchSize), threads); });
+                    erosionUnit = "droplets";
+                }
+                else
+                {
+                    // The solver works on the noise, one unit per sample, the shader scales it by (distance, mapHeight)
+                    thermalOptions.talus = tan(glm::radians(talusAngle)) * plane.distance / max(plane.mapHeight, 0.01f);
+                    auto thermal = make_shared<ThermalErosion>(map.width, map.height, thermalOptions);
+                    erosion.start(map.samples, thermalOptions.iterations, [thermal, threads](vector<float> &heights, size_t limit)
+                                  { return (size_t)thermal->run(heights, (int)min(limit, (size_t)thermal->getOptions().batchSize), threads); });
+                    erosionUnit = "iterations";
+                }
+                erodedVersion = plane.getNoiseVersion();
+            }
+        }
+        // New options regenerate the noise, the erosion of the old one is thrown away
+        if (plane.getNoiseVersion() != erodedVersion)
+            erosion.stop();
+        if (erosion.takeHeights(erodedNoise) && plane.getNoiseVersion() == erodedVersion)
+        {
+            ProfileScope scope("Upload", true);
+            plane.setNoise(erodedNoise);
+        }
+        ImGui::Text("%zu %s, %.0f %s/s", erosion.getDone(), erosionUnit, erosion.getRate(), erosionUnit);
+        ImGui::End();
+
+        ImGui::Begin("Rendering");
+        ImGui::Checkbox("Render on demand", &renderSettings.onDemand);
+        ImGui::SliderInt("Max FPS", &renderSettings.maxFPS, 0, 240);
+        ImGui::SliderFloat("Idle refresh (s)", &renderSettings.minRefresh, 0.05f, 5.0f);
+        ImGui::Text("Frames drawn: %u, idle waits: %u", drawnFrames, skippedWaits);
+        ImGui::End();
+
+        ImGui::Begin("Profiler");
+        ImGui::Checkbox("Enabled", &Profiler::enabled);
+        if (!Trace::isEnabled() && ImGui::Button("Start trace", ImVec2(100, 30)))
+        {
+            Trace::start("trace.json");
+            Trace::setThreadName("main");
+        }
+        else if (Trace::isEnabled() && ImGui::Button("Stop trace", ImVec2(100, 30)))
+        {
+            Trace::stop();
+        }
+        if (Trace::isEnabled())
+            ImGui::Text("Capturing: %zu events", Trace::getEventCount());
+        ImGui::Text("Average / max over the last %d frames (ms)", PROFILER_HISTORY);
+        for (const ProfileStage &stage : Profiler::getStages())
+        {
+            ImGui::PushID(&stage);
+            ImGui::Indent(stage.depth * 10.0f + 1.0f);
+            ImGui::Text("%s  CPU %.3f / %.3f", stage.name.c_str(), stage.cpuAvg, stage.cpuMax);
+            ImGui::PlotHistogram("##cpu", stage.cpuHistory.data(), PROFILER_HISTORY, Profiler::getHistoryOffset(), NULL, 0.0f, stage.cpuMax, ImVec2(0, 30));
+            if (stage.gpu)
+            {
+                ImGui::Text("GPU %.3f / %.3f", stage.gpuAvg, stage.gpuMax);
+                ImGui::PlotHistogram("##gpu", stage.gpuHistory.data(), PROFILER_HISTORY, Profiler::getHistoryOffset(), NULL, 0.0f, stage.gpuMax, ImVec2(0, 30));
+            }
+            ImGui::Unindent(stage.depth * 10.0f + 1.0f);
+            ImGui::PopID();
+        }
+        ImGui::End();
+
+        ImGui::Begin("Interaction");
+        if (recorder.getMode() == InteractionRecorder::IDLE)
+        {
+            if (ImGui::Button("Record", ImVec2(100, 30)))
+                recorder.startRecording(glfwGetTime(), plane, camera);
+            ImGui::SameLine();
+            if (ImGui::Button("Replay", ImVec2(100, 30)) && recorder.startReplay("interaction.txt", glfwGetTime()))
+                replayReport = true;
+        }
+        else if (recorder.getMode() == InteractionRecorder::RECORDING)
+        {
+            if (ImGui::Button("Stop", ImVec2(100, 30)))
+                recorder.stopRecording("interaction.txt");
+            ImGui::Text("Recording: %zu events", recorder.getEventCount());
+        }
+        else
+        {
+            ImGui::Text("Replaying %zu events", recorder.getEventCount());
+        }
+        if (!recorder.getLatencies().empty())
+        {
+            ImGui::Text("Change to frame (ms): p50 %.2f  p95 %.2f  p99 %.2f", recorder.percentile(50), recorder.percentile(95), recorder.percentile(99));
+            ImGui::PlotHistogram("##latency", recorder.getLatencies().data(), recorder.getLatencies().size(), 0, NULL, 0.0f, recorder.percentile(100), ImVec2(0, 40));
+        }
+        ImGui::End();
+        recorder.record(glfwGetTime(), plane, camera);
+
+        // A widget held down (dragging a slider) keeps the loop awake
+        // and so does a refine, a seed batch or an erosion until they are done
+        if (ImGui::IsAnyItemActive() || plane.isRefining() || seedBrowser.isRunning() || erosion.isRunning())
+            pendingFrames = SETTLE_FRAMES;
+
+        {
+            ProfileScope scope("ImGui render", true);
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
         // Draw the Terrain
         if (drawTerrain)
         {
-            plane.checkUpdate();
-            plane.drawTerrain(shaderProgram);
+            if (plane.checkUpdate())
+                pendingFrames = SETTLE_FRAMES;
+            ProfileScope scope("Terrain draw", true);
+            plane.drawTerrain(shaders.get(plane.getFeatures(lighting)));
         }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            ProfileScope scope("Swap");
+            glfwSwapBuffers(window);
+        }
+        recorder.frameSubmitted();
+        // The latencies are taken when the GPU finishes, the frame cap below isn't part of them
+        recorder.finishFrames();
+        Profiler::end(frameStage);
+        Profiler::endFrame();
+
+        if (replayReport && recorder.getMode() == InteractionRecorder::IDLE && !recorder.isBusy())
+        {
+            recorder.report(cout);
+            replayReport = false;
+        }
+
+        // Frame rate cap, the events are polled at the start of the next frame
+        if (renderSettings.maxFPS > 0)
+        {
+            float remaining = 1.0f / renderSettings.maxFPS - (glfwGetTime() - frameStart);
+            if (remaining > 0.0f)
+                this_thread::sleep_for(chrono::duration<float>(remaining));
+        }
     }
     // Delete ImGui
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
     // Delete all objects we've created
-    shaderProgram.Delete();
+    shaders.Delete();
+    Profiler::Delete();
+    plane.Delete();
+    seedBrowser.stop();
+    seedBrowser.Delete();
+    erosion.stop();
+    cameraUBO.Delete();
+    lightsUBO.Delete();
+    // Anything still live on the GPU at this point was leaked
+    MemoryTracker::report(cout);
+    // Writes the capture if it's still running
+    Trace::stop();
     // Destroy Window object
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -227,9 +623,25 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
     camera.updateViewport(width, height);
+    pendingFrames = SETTLE_FRAMES;
+}
+
+// glfw: keys, mouse and text input wake the render loop
+// ---------------------------------------------------------------------------------------------
+void input_callback(GLFWwindow *window)
+{
+    pendingFrames = SETTLE_FRAMES;
+}
+
+// glfw: the window contents were damaged (uncovered, restored) and must be drawn again
+// ---------------------------------------------------------------------------------------------
+void refresh_callback(GLFWwindow *window)
+{
+    pendingFrames = SETTLE_FRAMES;
 }
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 {
     camera.processMouseScroll((float)(yoffset));
+    pendingFrames = SETTLE_FRAMES;
 }
@@ -1,3 +1,3 @@
 #!/bin/bash
-g++ imgui/*.cpp src/*.cpp main.cpp -o app glad.o -lglfw -lassimp -ldl && ./app
+g++ -O3 imgui/*.cpp src/*.cpp main.cpp -o app glad.o -lglfw -lassimp -ldl && ./app
 exit 1
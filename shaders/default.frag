@@ -1,32 +1,28 @@
 #version 330 core
 
+// Features of the variant, Shader inserts the #defines of ShaderFeatures after the version
+// NUM_POINT_LIGHTS: point lights evaluated (0 to NR_POINT_LIGHTS)
+// USE_SPOT_LIGHT: evaluates the spot light
+// USE_TEXTURES: material samplers, the specular map modulates the highlights
+// TERRAIN_COLORS: base color from the ColorBands palette instead of the diffuse texture
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+#if !defined(TERRAIN_COLORS) && !defined(USE_TEXTURES)
+#define TERRAIN_COLORS
+#endif
+
 // Outputs colors in RGBA
 out vec4 FragColor;
 
 struct Material{
+#ifdef USE_TEXTURES
 	sampler2D diffuse0;
 	sampler2D specular0;
+#endif
 	float shininess;
 };
 
-struct Light{
-	vec3 position; 
-	vec3 direction;
-	// for the Spotlight
-	float cutOffAngle;
-	float outerCutOffAngle;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;	
-
-	// for the attenuation
-	float constant;
-	float linear;
-	float quadratic;
-
-};
-
 struct DirLight {
 	vec3 direction;
 	vec3 ambient;
@@ -34,26 +30,26 @@ struct DirLight {
 	vec3 specular;
 };
 
-uniform DirLight dirLight;
 // Function to calculate directional light
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 
+// The floats fill the padding of the vec3s in std140 (see Lights.h)
 struct PointLight {
 	
 	vec3 position;
-	vec3 direction;
 	float constant;
+	vec3 direction;
 	float linear;
-	float quadratic;
 
 	vec3 ambient;
+	float quadratic;
 	vec3 diffuse;
 	vec3 specular;
 };
 
 
+// Size of the Lights block, the same in every variant so they share the buffer
 #define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS]; //like C-array
 
 // Function to calculate pointings lights
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
@@ -67,17 +63,47 @@ struct SpotLight
 	float outerCutOffAngle;
 };
 
-uniform SpotLight spotLight;
 vec3 CalcSpotLight(SpotLight light,vec3 normal, vec3 fragPos,vec3 viewDir);
 
 
+// Lights of the scene, shared by every program and written once per frame
+layout (std140) uniform Lights
+{
+	DirLight dirLight;
+	PointLight pointLights[NR_POINT_LIGHTS]; //like C-array
+	SpotLight spotLight;
+};
+
+// Camera of the frame, shared with the Vertex Shader
+layout (std140) uniform Camera
+{
+	mat4 camMatrix;
+	vec3 camPos;
+};
+
 uniform Material material;
-uniform Light light;
 
-// Imports the color from the Vertex Shader
-in vec3 color;
+#ifdef TERRAIN_COLORS
+#define MAX_COLOR_BANDS 8
+// Terrain palette, shared with Terrain::updateColorBands
+layout (std140) uniform ColorBands
+{
+	vec4 bands[MAX_COLOR_BANDS]; // rgb: color, a: upper noise threshold
+	int numBands;
+};
+vec3 CalcBandColor(float noise);
+
+// Imports the noise value from the Vertex Shader
+in float noiseHeight;
+#endif
+#ifdef USE_TEXTURES
 // Imports the texture coordinates from the Vertex Shader
 in vec2 texCoord;
+#endif
+// Color of the fragment taken from the palette or the diffuse texture
+vec3 color;
+// Color of the highlights
+vec3 specColor;
 // Imports the normal from the Vertex Shader
 in vec3 Normal;
 // Imports the current position of the fragment from the Vertex Shader
@@ -87,8 +113,6 @@ in vec3 FragPos;
 uniform vec4 lightColor;
 // Gets the position of the light from the main function
 // uniform vec3 lightPos;
-// Gets the position of the camera from the main function
-uniform vec3 camPos;
 
 // uniform vec4 campPos
 
@@ -96,6 +120,16 @@ void main()
 {
 
 	// properties
+#ifdef TERRAIN_COLORS
+	color = CalcBandColor(noiseHeight);
+#else
+	color = vec3(texture(material.diffuse0, texCoord));
+#endif
+#ifdef USE_TEXTURES
+	specColor = vec3(texture(material.specular0, texCoord));
+#else
+	specColor = color;
+#endif
 	vec3 norm = normalize(Normal);
 	vec3 viewDir = normalize(camPos - FragPos);
 
@@ -103,15 +137,29 @@ void main()
 	vec3 result = CalcDirLight(dirLight, norm, viewDir);
 
 	// phase 2: Point lights
-	//for(int i = 0; i < NR_POINT_LIGHTS; i++){
-	//	result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-	//}
+	for(int i = 0; i < NUM_POINT_LIGHTS; i++){
+		result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+	}
 	// phase 3: Spot light
-	//result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#ifdef USE_SPOT_LIGHT
+	result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
 	
 	FragColor = vec4(result, 1.0);
 }
 
+#ifdef TERRAIN_COLORS
+vec3 CalcBandColor(float noise)
+{
+	// The last band takes every value above the previous thresholds
+	for(int i = 0; i < numBands - 1; i++){
+		if(noise < bands[i].a)
+			return bands[i].rgb;
+	}
+	return bands[numBands - 1].rgb;
+}
+#endif
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
 	vec3 lightDir = normalize(-light.direction);
@@ -129,7 +177,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 	// vec3 specular = light.specular * spec * vec3(texture(material.specular0,texCoord));
 	vec3 ambient = light.ambient * color;
 	vec3 diffuse = light.diffuse * diff * color;
-	vec3 specular = light.specular * spec * color;
+	vec3 specular = light.specular * spec * specColor;
 
 	return (ambient + diffuse + specular);
 
@@ -147,9 +195,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 	float distance = length(light.position - fragPos);
 	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse0, texCoord));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse0, texCoord));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular0, texCoord));
+	vec3 ambient = light.ambient * color;
+	vec3 diffuse = light.diffuse * diff * color;
+	vec3 specular = light.specular * spec * specColor;
 
 	ambient *= attenuation;
 	diffuse *= attenuation;
@@ -1,40 +1,81 @@
 #version 330 core
 
+// TERRAIN_COLORS (see default.frag) selects the terrain streams, otherwise the
+// interleaved vertices of the models are used (always with USE_TEXTURES)
+#if !defined(TERRAIN_COLORS) && !defined(USE_TEXTURES)
+#define TERRAIN_COLORS
+#endif
+
+#ifdef TERRAIN_COLORS
+// Position in the grid (X, Z), the terrain is stored unscaled
+layout (location = 0) in vec2 aGrid;
+// Normals of the unscaled grid (distance = 1, height = noise)
+layout (location = 1) in vec3 aNormal;
+// Noise value of the vertex
+layout (location = 2) in float aHeight;
+
+// Outputs the noise value of the vertex, the Fragment Shader picks the color with it
+out float noiseHeight;
+#else
 // Position/Coordinates
 layout (location = 0) in vec3 aPos;
 // Normals
 layout (location = 1) in vec3 aNormal;
 // Texture coordinates
-layout (location = 2) in vec3 aColor;
+layout (location = 2) in vec2 aTexCoords;
+#endif
 
-// Outputs the color for the Fragment Shader
-out vec3 color;
+#ifdef USE_TEXTURES
 // Outputs the texture coordinates to the fragment shader
-// out vec2 texCoord;
+out vec2 texCoord;
+#endif
 
 out vec3 Normal;
 // Outputs the current position of the fragment because the light calculations are made in world space
 out vec3 FragPos;
 
-uniform mat4 camMatrix;
+// Camera of the frame, shared with the Fragment Shader
+layout (std140) uniform Camera
+{
+	mat4 camMatrix;
+	vec3 camPos;
+};
+
 uniform mat4 model;
 uniform float scale;
+#ifdef TERRAIN_COLORS
+// Separation between the vertices of the grid
+uniform float gridDistance;
+uniform float mapHeight;
+#endif
 
 void main()
 {  
+#ifdef TERRAIN_COLORS
+   vec3 aPos = vec3(aGrid.x * gridDistance, 1.0 + aHeight * mapHeight, aGrid.y * gridDistance);
+#endif
    vec3 scaledPos = vec3(aPos.x * scale, aPos.y * scale, aPos.z * scale);
    FragPos = vec3(model * vec4(scaledPos, 1.0f));
 
    // Outputs the positions/coordinates of all vertices
    gl_Position = camMatrix * vec4(FragPos, 1.0);
 
-   // Assigns the colors from the Vertex Data to the "color"
-   // color = aColor;
+#ifdef TERRAIN_COLORS
+   noiseHeight = aHeight;
 
-   // Assigns the color of the vertices from the Vertex Data to "Color"
-   color = aColor;
+   // The grid is scaled by (distance, mapHeight, distance), so the normals are scaled
+   // by its cofactor matrix (mapHeight, distance, mapHeight) * distance
+   vec3 gridNormal = normalize(aNormal * vec3(mapHeight, gridDistance, mapHeight));
+#ifdef USE_TEXTURES
+   // The textures repeat once per grid cell
+   texCoord = aGrid;
+#endif
+#else
+   texCoord = aTexCoords;
+   vec3 gridNormal = aNormal;
+#endif
 
    // Assigns the Normal coordinates from the Vertex Data to "aNormal"
    //Normal = mat3(transpose(inverse(model))) * aNormal; // for non-uniform scale
-    Normal = vec3(model * vec4(aNormal, 0.0)); // works with rotations/translations because is orthonormal
+    Normal = vec3(model * vec4(gridNormal, 0.0)); // works with rotations/translations because is orthonormal
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "../include/Bounds.h"
+#include <utility>
+
+void BoundingBox::expand(glm::vec3 point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void BoundingBox::merge(const BoundingBox &box)
+{
+    if (box.isEmpty())
+        return;
+    expand(box.min);
+    expand(box.max);
+}
+
+bool BoundingBox::contains(glm::vec3 point) const
+{
+    return point.x >= min.x && point.x <= max.x &&
+           point.y >= min.y && point.y <= max.y &&
+           point.z >= min.z && point.z <= max.z;
+}
+
+bool BoundingBox::intersectRay(glm::vec3 origin, glm::vec3 dir, float &t) const
+{
+    if (isEmpty())
+        return false;
+    float tNear = 0.0f, tFar = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Parallel to the slab, it's a hit only if the origin is between the planes
+        if (dir[axis] == 0.0f)
+        {
+            if (origin[axis] < min[axis] || origin[axis] > max[axis])
+                return false;
+            continue;
+        }
+        float t1 = (min[axis] - origin[axis]) / dir[axis];
+        float t2 = (max[axis] - origin[axis]) / dir[axis];
+        if (t1 > t2)
+            std::swap(t1, t2);
+        tNear = glm::max(tNear, t1);
+        tFar = glm::min(tFar, t2);
+        if (tNear > tFar)
+            return false;
+    }
+    t = tNear;
+    return true;
+}
+
+BoundingSphere::BoundingSphere(const BoundingBox &box)
+{
+    if (box.isEmpty())
+        return;
+    center = box.center();
+    radius = glm::length(box.size()) * 0.5f;
+}
+
+bool BoundingSphere::contains(glm::vec3 point) const
+{
+    glm::vec3 offset = point - center;
+    return glm::dot(offset, offset) <= radius * radius;
+}
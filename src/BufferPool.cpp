@@ -0,0 +1,17 @@
+#include "../include/BufferPool.h"
+
+size_t BufferPool::reservedBytes() const
+{
+    size_t total = 0;
+    for (auto &buffer : buffers)
+        total += buffer.reserved();
+    return total;
+}
+
+size_t BufferPool::usedBytes() const
+{
+    size_t total = 0;
+    for (auto &buffer : buffers)
+        total += buffer.used();
+    return total;
+}
@@ -6,7 +6,24 @@ EBO::EBO(vector<GLuint> &indices)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
 
     // Introduce the vertices into the VBO
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    size = indices.size() * sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices.data(), GL_STATIC_DRAW);
+    MemoryTracker::allocate(MEM_GPU_BUFFERS, size);
+}
+
+EBO::EBO()
+{
+    glGenBuffers(1, &ID);
+    MemoryTracker::allocate(MEM_GPU_BUFFERS, 0);
+}
+
+void EBO::update(vector<GLuint> &indices)
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
+    GLsizeiptr newSize = indices.size() * sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, newSize, indices.data(), GL_STATIC_DRAW);
+    MemoryTracker::resize(MEM_GPU_BUFFERS, size, newSize);
+    size = newSize;
 }
 
 void EBO::Bind()
@@ -22,4 +39,6 @@ void EBO::Unbind()
 void EBO::Delete()
 {
     glDeleteBuffers(1, &ID);
+    MemoryTracker::release(MEM_GPU_BUFFERS, size);
+    size = 0;
 }
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "../include/Erosion.h"
+#include "../include/Trace.h"
+
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+HydraulicErosion::HydraulicErosion(int width, int height, const ErosionOptions &options) : width(width), height(height), options(options)
+{
+    // The brush must fit in the half tile a droplet can wander out of its own
+    this->options.radius = max(0, min(options.radius, EROSION_TILE_SIZE / 2 - 2));
+    this->options.lifetime = max(1, options.lifetime);
+    // Droplets start in [0, side - 1) so the bilinear samples stay inside the map
+    tilesX = max(1, (width - 1 + EROSION_TILE_SIZE - 1) / EROSION_TILE_SIZE);
+    tilesY = max(1, (height - 1 + EROSION_TILE_SIZE - 1) / EROSION_TILE_SIZE);
+
+    // The weights fall linearly with the distance and add up to 1
+    int radius = this->options.radius;
+    float total = 0.0f;
+    for (int y = -radius; y <= radius; y++)
+    {
+        for (int x = -radius; x <= radius; x++)
+        {
+            float weight = radius + 1 - sqrt((float)(x * x + y * y));
+            if (weight <= 0.0f)
+                continue;
+            brushX.push_back(x);
+            brushY.push_back(y);
+            brushWeights.push_back(weight);
+            total += weight;
+        }
+    }
+    for (float &weight : brushWeights)
+        weight /= total;
+}
+
+int HydraulicErosion::runBatch(float *heights, int count, int threads)
+{
+    if (width < 2 || height < 2 || count <= 0)
+        return 0;
+    TraceScope trace("Erosion batch", {{"droplets", count}});
+    // Every tile gets the droplets of its share of the map
+    vector<int> tileDroplets(tilesX * tilesY);
+    long long area = (long long)(width - 1) * (height - 1);
+    int simulated = 0;
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        for (int tx = 0; tx < tilesX; tx++)
+        {
+            long long tileArea = (long long)(min((tx + 1) * EROSION_TILE_SIZE, width - 1) - tx * EROSION_TILE_SIZE) *
+                                 (min((ty + 1) * EROSION_TILE_SIZE, height - 1) - ty * EROSION_TILE_SIZE);
+            tileDroplets[ty * tilesX + tx] = (int)((count * tileArea + area / 2) / area);
+            simulated += tileDroplets[ty * tilesX + tx];
+        }
+    }
+
+    // The tiles of a phase are two apart, the droplets of one never reach the samples of another
+    for (int phase = 0; phase < 4; phase++)
+    {
+        vector<pair<int, int>> tiles;
+        for (int ty = phase >> 1; ty < tilesY; ty += 2)
+            for (int tx = phase & 1; tx < tilesX; tx += 2)
+                tiles.push_back({tx, ty});
+        atomic<int> next(0);
+        auto work = [&]()
+        {
+            for (int i = next++; i < (int)tiles.size(); i = next++)
+                runTile(heights, tiles[i].first, tiles[i].second, tileDroplets[tiles[i].second * tilesX + tiles[i].first]);
+        };
+        vector<thread> workers;
+        int workerCount = max(1, min(threads, (int)tiles.size()));
+        for (int i = 1; i < workerCount; i++)
+            workers.emplace_back(work);
+        work();
+        for (auto &worker : workers)
+            worker.join();
+    }
+    batches++;
+    return simulated;
+}
+
+void HydraulicErosion::runTile(float *heights, int tx, int ty, int count)
+{
+    int x0 = tx * EROSION_TILE_SIZE, y0 = ty * EROSION_TILE_SIZE;
+    int half = EROSION_TILE_SIZE / 2, radius = options.radius;
+    // The droplet dies when it leaves half a tile around its own, minus the brush
+    float minX = max(x0 - half + radius + 1, 0), maxX = min(x0 + EROSION_TILE_SIZE + half - radius - 2, width - 1);
+    float minY = max(y0 - half + radius + 1, 0), maxY = min(y0 + EROSION_TILE_SIZE + half - radius - 2, height - 1);
+    // Same droplets for the same seed, batch and tile, whatever thread runs it
+    seed_seq sequence{options.seed, (unsigned int)batches, (unsigned int)tx, (unsigned int)ty};
+    mt19937 random(sequence);
+    uniform_real_distribution<float> startX(x0, min(x0 + EROSION_TILE_SIZE, width - 1));
+    uniform_real_distribution<float> startY(y0, min(y0 + EROSION_TILE_SIZE, height - 1));
+
+    for (int droplet = 0; droplet < count; droplet++)
+    {
+        float posX = startX(random), posY = startY(random);
+        float dirX = 0.0f, dirY = 0.0f;
+        float speed = 1.0f, water = 1.0f, sediment = 0.0f;
+        for (int life = 0; life < options.lifetime; life++)
+        {
+            int nodeX = (int)posX, nodeY = (int)posY;
+            float cellX = posX - nodeX, cellY = posY - nodeY;
+            float currentHeight, gradX, gradY;
+            sample(heights, posX, posY, currentHeight, gradX, gradY);
+
+            // Downhill, keeping some of the previous direction
+            dirX = dirX * options.inertia - gradX * (1.0f - options.inertia);
+            dirY = dirY * options.inertia - gradY * (1.0f - options.inertia);
+            float length = sqrt(dirX * dirX + dirY * dirY);
+            if (length == 0.0f)
+                break;
+            posX += dirX / length;
+            posY += dirY / length;
+            if (posX < minX || posX >= maxX || posY < minY || posY >= maxY)
+                break;
+
+            float newHeight, unusedX, unusedY;
+            sample(heights, posX, posY, newHeight, unusedX, unusedY);
+            float deltaHeight = newHeight - currentHeight;
+            float capacity = max(-deltaHeight * speed * water * options.capacity, options.minCapacity);
+            if (sediment > capacity || deltaHeight > 0.0f)
+            {
+                // Uphill it fills the pit behind it, otherwise it drops what it can't carry
+                float amount = deltaHeight > 0.0f ? min(deltaHeight, sediment) : (sediment - capacity) * options.depositSpeed;
+                sediment -= amount;
+                size_t node = (size_t)nodeY * width + nodeX;
+                heights[node] += amount * (1.0f - cellX) * (1.0f - cellY);
+                heights[node + 1] += amount * cellX * (1.0f - cellY);
+                heights[node + width] += amount * (1.0f - cellX) * cellY;
+                heights[node + width + 1] += amount * cellX * cellY;
+            }
+            else
+            {
+                // Never digs deeper than the drop, that would leave a hole behind
+                float amount = min((capacity - sediment) * options.erodeSpeed, -deltaHeight);
+                for (size_t k = 0; k < brushWeights.size(); k++)
+                {
+                    int x = nodeX + brushX[k], y = nodeY + brushY[k];
+                    if (x < 0 || x >= width || y < 0 || y >= height)
+                        continue;
+                    float taken = amount * brushWeights[k];
+                    heights[(size_t)y * width + x] -= taken;
+                    sediment += taken;
+                }
+            }
+            speed = sqrt(max(0.0f, speed * speed - deltaHeight * options.gravity));
+            water *= 1.0f - options.evaporateSpeed;
+        }
+    }
+}
+
+void HydraulicErosion::sample(const float *heights, float x, float y, float &h, float &gradX, float &gradY) const
+{
+    int nodeX = (int)x, nodeY = (int)y;
+    float cellX = x - nodeX, cellY = y - nodeY;
+    size_t node = (size_t)nodeY * width + nodeX;
+    float heightNW = heights[node], heightNE = heights[node + 1];
+    float heightSW = heights[node + width], heightSE = heights[node + width + 1];
+    gradX = (heightNE - heightNW) * (1.0f - cellY) + (heightSE - heightSW) * cellY;
+    gradY = (heightSW - heightNW) * (1.0f - cellX) + (heightSE - heightNE) * cellX;
+    h = heightNW * (1.0f - cellX) * (1.0f - cellY) + heightNE * cellX * (1.0f - cellY) +
+        heightSW * (1.0f - cellX) * cellY + heightSE * cellX * cellY;
+}
+
+ThermalErosion::ThermalErosion(int width, int height, const ThermalOptions &options) : width(width), height(height), options(options)
+{
+    this->options.talus = max(0.0f, options.talus);
+    // Past 1 the pairs overshoot and it oscillates
+    this->options.rate = min(max(options.rate, 0.0f), 1.0f);
+}
+
+int ThermalErosion::run(vector<float> &heights, int count, int threads)
+{
+    if (converged || width < 1 || height < 1 || heights.size() != (size_t)width * height)
+        return 0;
+    next.resize(heights.size());
+    int iterations = 0;
+    while (iterations < count && !converged)
+    {
+        TraceScope trace("Thermal iteration", {{"iteration", iterations}});
+        // Every point only depends on the previous iteration, so the rows are split in bands
+        int bands = max(1, min(threads, height));
+        vector<int> bandMoving(bands);
+        vector<thread> workers;
+        for (int band = 1; band < bands; band++)
+        {
+            workers.emplace_back([&, band]()
+                                 { bandMoving[band] = iterateRows(heights.data(), next.data(), band * height / bands, (band + 1) * height / bands); });
+        }
+        bandMoving[0] = iterateRows(heights.data(), next.data(), 0, height / bands);
+        for (auto &worker : workers)
+            worker.join();
+        heights.swap(next);
+        iterations++;
+        lastMoving = accumulate(bandMoving.begin(), bandMoving.end(), 0);
+        converged = lastMoving == 0;
+    }
+    return iterations;
+}
+
+int ThermalErosion::iterateRows(const float *heights, float *out, int firstRow, int lastRow) const
+{
+    // Each neighbor pair moves rate / 4 of its excess, with all 4 neighbors lower a
+    // sample loses at most the excess of rate, it never ends below them
+    float share = options.rate * 0.25f, talus = options.talus, tolerance = options.tolerance;
+    // A count instead of the biggest change, a float max doesn't vectorize without fast math
+    int moving = 0;
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        if (y == 0 || y == height - 1 || width < 3)
+        {
+            for (int x = 0; x < width; x++)
+                moving += iterateBorder(heights, out, x, y);
+            continue;
+        }
+        const float *row = heights + (size_t)y * width;
+        const float *up = row - width, *down = row + width;
+        float *outRow = out + (size_t)y * width;
+        moving += iterateBorder(heights, out, 0, y);
+        moving += iterateBorder(heights, out, width - 1, y);
+        // The part of the difference past the talus, 0 inside [-talus, talus]
+        for (int x = 1; x < width - 1; x++)
+        {
+            float center = row[x];
+            float left = row[x - 1] - center, right = row[x + 1] - center;
+            float top = up[x] - center, bottom = down[x] - center;
+            float flow = (left - min(max(left, -talus), talus)) + (right - min(max(right, -talus), talus)) +
+                         (top - min(max(top, -talus), talus)) + (bottom - min(max(bottom, -talus), talus));
+            float moved = share * flow;
+            outRow[x] = center + moved;
+            moving += fabs(moved) > tolerance;
+        }
+    }
+    return moving;
+}
+
+bool ThermalErosion::iterateBorder(const float *heights, float *out, int x, int y) const
+{
+    float share = options.rate * 0.25f, talus = options.talus;
+    float center = heights[(size_t)y * width + x];
+    float flow = 0.0f;
+    const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (auto &offset : offsets)
+    {
+        int nx = x + offset[0], ny = y + offset[1];
+        if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+            continue;
+        float difference = heights[(size_t)ny * width + nx] - center;
+        flow += difference - min(max(difference, -talus), talus);
+    }
+    float moved = share * flow;
+    out[(size_t)y * width + x] = center + moved;
+    return fabs(moved) > options.tolerance;
+}
+
+void ErosionTask::start(const vector<float> &heights, size_t budget, Batch batch)
+{
+    stop();
+    working = heights;
+    {
+        lock_guard<mutex> lock(publishMutex);
+        fresh = false;
+    }
+    done = 0;
+    cancelled = false;
+    running = true;
+    startTime = now();
+    endTime = 0.0;
+    worker = thread([this, budget, batch]()
+                    {
+                        while (!cancelled && done < budget)
+                        {
+                            size_t units = batch(working, budget - done);
+                            if (units == 0)
+                                break;
+                            done += units;
+                            publish(false);
+                        }
+                        // The final heights are always published
+                        publish(true);
+                        endTime = now();
+                        running = false; });
+}
+
+void ErosionTask::stop()
+{
+    cancelled = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+bool ErosionTask::takeHeights(vector<float> &heights)
+{
+    lock_guard<mutex> lock(publishMutex);
+    if (!fresh)
+        return false;
+    heights.swap(published);
+    fresh = false;
+    return true;
+}
+
+float ErosionTask::getRate()
+{
+    double elapsed = (running ? now() : endTime.load()) - startTime;
+    return elapsed > 0.0 ? done / elapsed : 0.0f;
+}
+
+void ErosionTask::publish(bool force)
+{
+    lock_guard<mutex> lock(publishMutex);
+    // The main thread didn't take the last one yet, the copy can wait for the next batch
+    if (fresh && !force)
+        return;
+    published = working;
+    fresh = true;
+}
+
+double ErosionTask::now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,210 @@
+#include "../include/GoldenCheck.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+vector<GoldenCase> GoldenCheck::getMatrix()
+{
+    // seed, dimension, layers, frequency, persistance, lacunarity
+    return {
+        {1, 16, 1, 1.0f, 0.5f, 2.0f},
+        {1, 64, 4, 2.0f, 0.5f, 2.0f},
+        {42, 64, 8, 3.5f, 0.4f, 2.5f},
+        {42, 150, 5, 4.0f, 0.5f, 2.0f},
+        {1337, 101, 3, 6.0f, 0.7f, 1.5f},
+        {1337, 33, 6, 9.5f, 0.9f, 3.0f},
+        {7, 200, 2, 1.5f, 0.3f, 1.2f},
+        {0, 1, 1, 1.0f, 0.5f, 2.0f},
+    };
+}
+
+vector<int> GoldenCheck::getThreadCounts()
+{
+    // 3 leaves bands of different sizes
+    return {1, 2, 3, 4, 8};
+}
+
+GoldenResult GoldenCheck::run(Terrain &terrain, const GoldenCase &test, int threads)
+{
+    terrain.threads = threads;
+    terrain.resetCopiedBytes();
+    terrain.setSeed(test.seed);
+    // The options go through checkUpdate, like a slider would
+    terrain.dimension = test.dimension;
+    terrain.layers = test.layers;
+    terrain.frequency = test.frequency;
+    terrain.persistance = test.persistance;
+    terrain.lacunarity = test.lacunarity;
+    terrain.checkUpdate();
+
+    GoldenResult result;
+    result.copiedBytes = terrain.getCopiedBytes();
+    result.heightmap = checksum(terrain.terrainPos.data(), terrain.terrainPos.size() * sizeof(GLfloat), 0);
+    const Mesh &mesh = terrain.getMesh();
+    result.mesh = 0;
+    for (auto &stream : mesh.streams)
+        result.mesh = checksum(stream.data.data(), stream.data.size() * sizeof(GLfloat), result.mesh);
+    result.mesh = checksum(mesh.indices.data(), mesh.indices.size() * sizeof(GLuint), result.mesh);
+
+    // Scattered points, the lattice corners would all be 0.5
+    int n = test.dimension + 1;
+    for (int i = 0; i < GOLDEN_SAMPLES; i++)
+    {
+        int row = (i * 37 + 5) % n, col = (i * 53 + 11) % n;
+        result.samples[i] = terrain.terrainPos[row * n + col];
+    }
+    return result;
+}
+
+bool GoldenCheck::bless(Terrain &terrain, const string &path)
+{
+    ofstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::GOLDEN::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    file << "# seed dimension layers frequency persistance lacunarity heightmap mesh samples...\n";
+    for (const GoldenCase &test : getMatrix())
+    {
+        GoldenResult result = run(terrain, test, 1);
+        file << test.seed << " " << test.dimension << " " << test.layers << " " << setprecision(9)
+             << test.frequency << " " << test.persistance << " " << test.lacunarity << " " << hex
+             << result.heightmap << " " << result.mesh << dec;
+        for (int i = 0; i < GOLDEN_SAMPLES; i++)
+            file << " " << result.samples[i];
+        file << "\n";
+    }
+    cout << "Golden: " << getMatrix().size() << " cases written to " << path << "\n";
+    return true;
+}
+
+int GoldenCheck::verify(Terrain &terrain, const string &path, ostream &out)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        out << "ERROR::GOLDEN::CANNOT_READ: " << path << "\n";
+        return 1;
+    }
+    // The thread counts must really regenerate, the cache is checked on its own below
+    size_t budget = terrain.getResultCache().getBudget();
+    terrain.setCacheBudget(0);
+    int failures = 0, checks = 0;
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream in(line);
+        GoldenCase test;
+        GoldenResult expected;
+        in >> test.seed >> test.dimension >> test.layers >> test.frequency >> test.persistance >> test.lacunarity >> hex >> expected.heightmap >> expected.mesh >> dec;
+        for (int i = 0; i < GOLDEN_SAMPLES; i++)
+            in >> expected.samples[i];
+        if (!in)
+        {
+            out << "ERROR::GOLDEN::BAD_LINE: " << line << "\n";
+            failures++;
+            continue;
+        }
+
+        GoldenResult single;
+        for (int threads : getThreadCounts())
+        {
+            GoldenResult result = run(terrain, test, threads);
+            if (threads == 1)
+                single = result;
+            checks++;
+
+            // Every problem of the run is listed, the heights and the mesh are checked on their own
+            string problems;
+            auto fail = [&problems](const string &problem)
+            { problems += (problems.empty() ? "" : ", ") + problem; };
+            // Every thread count must give exactly the single threaded output
+            if (result.heightmap != single.heightmap || result.mesh != single.mesh)
+                fail("differs from 1 thread");
+            if (result.heightmap != expected.heightmap)
+                fail("heightmap");
+            if (result.mesh != expected.mesh)
+                fail("mesh");
+            // Without the cache the pipeline generates in place, nothing is copied
+            if (result.copiedBytes != 0)
+                fail("copied " + to_string(result.copiedBytes) + " bytes");
+            float maxError = 0.0f;
+            for (int i = 0; i < GOLDEN_SAMPLES; i++)
+                maxError = max(maxError, fabs(result.samples[i] - expected.samples[i]));
+
+            string status = problems.empty() ? "ok" : "FAIL (" + problems + ")";
+            if (!problems.empty())
+                failures++;
+            out << "seed " << test.seed << " dim " << test.dimension << " layers " << test.layers
+                << " threads " << threads << ": " << status;
+            if (maxError > 0.0f)
+                out << " max error " << maxError;
+            out << "\n";
+        }
+
+        // The second run of the same options comes from the result cache
+        terrain.setCacheBudget(RESULT_CACHE_BUDGET);
+        run(terrain, test, 1);
+        size_t hits = terrain.getResultCache().getHits();
+        GoldenResult cached = run(terrain, test, 1);
+        bool hit = terrain.getResultCache().getHits() > hits;
+        // A hit copies the stored result back and nothing else, the cache holds only that entry
+        bool copies = cached.copiedBytes == terrain.getResultCache().getBytes();
+        terrain.setCacheBudget(0);
+        checks++;
+        bool same = cached.heightmap == single.heightmap && cached.mesh == single.mesh;
+        if (!hit || !same || !copies)
+            failures++;
+        out << "seed " << test.seed << " dim " << test.dimension << " layers " << test.layers << " cached: "
+            << (!hit ? "FAIL (no cache hit)" : !same ? "FAIL (differs from the generated one)" : !copies ? "FAIL (copies)" : "ok") << "\n";
+    }
+    checks++;
+    if (!checkPreviewRelease(terrain, out))
+        failures++;
+    terrain.setCacheBudget(budget);
+    out << "Golden: " << checks - failures << "/" << checks << " checks passed\n";
+    return failures;
+}
+
+bool GoldenCheck::checkPreviewRelease(Terrain &terrain, ostream &out)
+{
+    // Big enough for a preview, generated once at full resolution so the cache has it
+    GoldenCase test = getMatrix()[1];
+    test.dimension = PREVIEW_MIN_DIMENSION + 44;
+    terrain.setCacheBudget(RESULT_CACHE_BUDGET);
+    run(terrain, test, 1);
+    // A slider dragged away and back, then released on the cached value
+    terrain.preview = true;
+    terrain.frequency = test.frequency * 2.0f;
+    terrain.checkUpdate();
+    terrain.frequency = test.frequency;
+    terrain.checkUpdate();
+    terrain.preview = false;
+    terrain.checkUpdate();
+    bool restored = !terrain.isRefining() && terrain.getWidth() == (GLuint)test.dimension;
+    // A refine that was started anyway is finished before the next check
+    while (terrain.isRefining())
+        terrain.checkUpdate();
+    terrain.setCacheBudget(0);
+    out << "seed " << test.seed << " dim " << test.dimension << " layers " << test.layers << " preview released: "
+        << (restored ? "ok" : "FAIL (refined instead of the cache)") << "\n";
+    return restored;
+}
+
+uint64_t GoldenCheck::checksum(const void *data, size_t bytes, uint64_t hash)
+{
+    // FNV-1a, hash = 0 starts a new checksum
+    if (hash == 0)
+        hash = 1469598103934665603ULL;
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
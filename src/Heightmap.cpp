@@ -0,0 +1,422 @@
+#include "../include/Heightmap.h"
+
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool HeightmapIO::saveRaw32(const string &path, const Heightmap &map)
+{
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        cout << "ERROR::HEIGHTMAP::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    file.write((const char *)map.samples.data(), map.samples.size() * sizeof(float));
+    return (bool)file;
+}
+
+bool HeightmapIO::loadRaw32(const string &path, Heightmap &map, int width)
+{
+    vector<char> bytes;
+    if (!readFile(path, bytes) || !getSize(bytes.size() / sizeof(float), width, map))
+        return false;
+    map.samples.resize((size_t)map.width * map.height);
+    memcpy(map.samples.data(), bytes.data(), map.samples.size() * sizeof(float));
+    return true;
+}
+
+bool HeightmapIO::saveRaw16(const string &path, const Heightmap &map)
+{
+    // The range of the samples maps to the 16 bits, an empty map has none
+    if (map.samples.empty())
+    {
+        cout << "ERROR::HEIGHTMAP::BAD_SIZE: " << path << " has no samples\n";
+        return false;
+    }
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        cout << "ERROR::HEIGHTMAP::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    float low = *min_element(map.samples.begin(), map.samples.end());
+    float high = *max_element(map.samples.begin(), map.samples.end());
+    float range = high > low ? high - low : 1.0f;
+    vector<uint16_t> values(map.samples.size());
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = (uint16_t)lround((map.samples[i] - low) / range * 65535.0f);
+    file.write((const char *)values.data(), values.size() * sizeof(uint16_t));
+    return (bool)file;
+}
+
+bool HeightmapIO::loadRaw16(const string &path, Heightmap &map, int width)
+{
+    vector<char> bytes;
+    if (!readFile(path, bytes) || !getSize(bytes.size() / sizeof(uint16_t), width, map))
+        return false;
+    map.samples.resize((size_t)map.width * map.height);
+    const uint16_t *values = (const uint16_t *)bytes.data();
+    for (size_t i = 0; i < map.samples.size(); i++)
+        map.samples[i] = values[i] / 65535.0f;
+    return true;
+}
+
+bool HeightmapIO::readFile(const string &path, vector<char> &bytes)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file)
+    {
+        cout << "ERROR::HEIGHTMAP::CANNOT_READ: " << path << "\n";
+        return false;
+    }
+    bytes.resize(file.tellg());
+    file.seekg(0);
+    file.read(bytes.data(), bytes.size());
+    return (bool)file;
+}
+
+bool HeightmapIO::getSize(size_t samples, int width, Heightmap &map)
+{
+    if (width <= 0)
+        width = (int)lround(sqrt((double)samples));
+    if (width <= 0 || samples % width != 0)
+    {
+        cout << "ERROR::HEIGHTMAP::BAD_SIZE: " << samples << " samples\n";
+        return false;
+    }
+    map.width = width;
+    map.height = samples / width;
+    return true;
+}
+
+size_t TiledHeader::tileIndex(int level, int tx, int ty) const
+{
+    size_t first = 0;
+    for (int l = 0; l < level; l++)
+        first += (size_t)tilesX(l) * tilesY(l);
+    return first + (size_t)ty * tilesX(level) + tx;
+}
+
+TiledHeader TiledHeader::describe(uint32_t width, uint32_t height, uint32_t tileSize, TileFormat format)
+{
+    TiledHeader header;
+    memcpy(header.magic, TILED_MAGIC, 4);
+    header.version = TILED_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.levels = countLevels(width, height, tileSize);
+    header.format = format;
+    header.reserved = 0;
+    header.minHeight = INFINITY;
+    header.maxHeight = -INFINITY;
+    return header;
+}
+
+uint32_t TiledHeader::countLevels(uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    uint32_t levels = 1;
+    while (width > tileSize || height > tileSize)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+uint32_t packNormal(float x, float y, float z)
+{
+    auto channel = [](float v)
+    { return (uint32_t)lround((max(-1.0f, min(v, 1.0f)) * 0.5f + 0.5f) * 255.0f); };
+    return channel(x) | channel(y) << 8 | channel(z) << 16 | 255u << 24;
+}
+
+void unpackNormal(uint32_t packed, float normal[3])
+{
+    for (int i = 0; i < 3; i++)
+        normal[i] = ((packed >> (8 * i)) & 255) / 255.0f * 2.0f - 1.0f;
+}
+
+TiledHeightmapWriter::~TiledHeightmapWriter()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool TiledHeightmapWriter::create(const string &path, int width, int height, int tileSize, TileFormat format, bool resume)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+    if (fd < 0)
+    {
+        cout << "ERROR::HEIGHTMAP::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    header = TiledHeader::describe(width, height, tileSize, format);
+
+    // Every tile has the same size, so the index is known before any tile is written
+    index.resize(header.tileCount());
+    uint64_t offset = sizeof(TiledHeader) + index.size() * sizeof(TileEntry);
+    for (auto &entry : index)
+    {
+        entry.offset = offset;
+        entry.size = header.tileBytes();
+        offset += entry.size;
+    }
+    return true;
+}
+
+bool TiledHeightmapWriter::writeTile(int tx, int ty, const void *tile)
+{
+    if (header.format == TILE_FLOAT32)
+    {
+        // Only the samples inside the map count for the range
+        const float *samples = (const float *)tile;
+        int w = min((int)header.tileSize, (int)header.width - tx * (int)header.tileSize);
+        int h = min((int)header.tileSize, (int)header.height - ty * (int)header.tileSize);
+        float low = INFINITY, high = -INFINITY;
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                low = min(low, samples[y * header.tileSize + x]);
+                high = max(high, samples[y * header.tileSize + x]);
+            }
+        }
+        lock_guard<mutex> lock(rangeMutex);
+        header.minHeight = min(header.minHeight, low);
+        header.maxHeight = max(header.maxHeight, high);
+    }
+    return writeTile(0, tx, ty, tile);
+}
+
+bool TiledHeightmapWriter::sync()
+{
+    return fdatasync(fd) == 0;
+}
+
+void TiledHeightmapWriter::getRange(float &minHeight, float &maxHeight)
+{
+    lock_guard<mutex> lock(rangeMutex);
+    minHeight = header.minHeight;
+    maxHeight = header.maxHeight;
+}
+
+void TiledHeightmapWriter::setRange(float minHeight, float maxHeight)
+{
+    lock_guard<mutex> lock(rangeMutex);
+    header.minHeight = minHeight;
+    header.maxHeight = maxHeight;
+}
+
+bool TiledHeightmapWriter::finish()
+{
+    int T = header.tileSize;
+    // The 2x2 tiles of the previous level behind one tile of the next, the
+    // samples are copied as 4 bytes whatever the format
+    vector<float> block(4 * T * T), tile(T * T), parent(T * T);
+    bool ok = true;
+    for (int level = 1; level < (int)header.levels && ok; level++)
+    {
+        for (int ty = 0; ty < header.tilesY(level) && ok; ty++)
+        {
+            for (int tx = 0; tx < header.tilesX(level) && ok; tx++)
+            {
+                for (int q = 0; q < 4; q++)
+                {
+                    int px = 2 * tx + (q & 1), py = 2 * ty + (q >> 1);
+                    if (px >= header.tilesX(level - 1) || py >= header.tilesY(level - 1))
+                        continue;
+                    ok &= readTile(level - 1, px, py, parent.data());
+                    for (int y = 0; y < T; y++)
+                        copy(&parent[y * T], &parent[y * T] + T, &block[((q >> 1) * T + y) * 2 * T + (q & 1) * T]);
+                }
+                downsample(header, level, tx, ty, block.data(), tile.data());
+                ok &= writeTile(level, tx, ty, tile.data());
+            }
+        }
+    }
+    ok &= pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+    ok &= pwrite(fd, index.data(), index.size() * sizeof(TileEntry), sizeof(header)) == (ssize_t)(index.size() * sizeof(TileEntry));
+    ::close(fd);
+    fd = -1;
+    return ok;
+}
+
+void TiledHeightmapWriter::downsample(const TiledHeader &header, int level, int tx, int ty, const float *block, float *tile)
+{
+    int T = header.tileSize;
+    // Box filter, the samples past the edge of the previous level are clamped,
+    // which always lands inside the block
+    int maxX = header.levelWidth(level - 1) - 1 - 2 * tx * T, maxY = header.levelHeight(level - 1) - 1 - 2 * ty * T;
+    for (int y = 0; y < T; y++)
+    {
+        int y0 = min(2 * y, maxY), y1 = min(2 * y + 1, maxY);
+        for (int x = 0; x < T; x++)
+        {
+            int x0 = min(2 * x, maxX), x1 = min(2 * x + 1, maxX);
+            if (header.format == TILE_FLOAT32)
+            {
+                tile[y * T + x] = 0.25f * (block[y0 * 2 * T + x0] + block[y0 * 2 * T + x1] +
+                                           block[y1 * 2 * T + x0] + block[y1 * 2 * T + x1]);
+                continue;
+            }
+            // Normals are averaged as vectors and made unit again
+            float sum[3] = {}, normal[3];
+            for (int i : {y0 * 2 * T + x0, y0 * 2 * T + x1, y1 * 2 * T + x0, y1 * 2 * T + x1})
+            {
+                uint32_t packed;
+                memcpy(&packed, &block[i], 4);
+                unpackNormal(packed, normal);
+                for (int c = 0; c < 3; c++)
+                    sum[c] += normal[c];
+            }
+            float length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            if (length > 0.0f)
+                for (int c = 0; c < 3; c++)
+                    sum[c] /= length;
+            uint32_t packed = packNormal(sum[0], sum[1], sum[2]);
+            memcpy(&tile[y * T + x], &packed, 4);
+        }
+    }
+}
+
+bool TiledHeightmapWriter::write(const string &path, const Heightmap &map, int tileSize)
+{
+    TiledHeightmapWriter writer;
+    if (!writer.create(path, map.width, map.height, tileSize))
+        return false;
+    const TiledHeader &header = writer.getHeader();
+    vector<float> tile(tileSize * tileSize);
+    for (int ty = 0; ty < header.tilesY(0); ty++)
+    {
+        for (int tx = 0; tx < header.tilesX(0); tx++)
+        {
+            for (int y = 0; y < tileSize; y++)
+            {
+                int my = min(ty * tileSize + y, map.height - 1);
+                for (int x = 0; x < tileSize; x++)
+                    tile[y * tileSize + x] = map.at(min(tx * tileSize + x, map.width - 1), my);
+            }
+            if (!writer.writeTile(tx, ty, tile.data()))
+                return false;
+        }
+    }
+    return writer.finish();
+}
+
+bool TiledHeightmapWriter::readTile(int level, int tx, int ty, void *tile)
+{
+    const TileEntry &entry = index[header.tileIndex(level, tx, ty)];
+    return pread(fd, tile, entry.size, entry.offset) == (ssize_t)entry.size;
+}
+
+bool TiledHeightmapWriter::writeTile(int level, int tx, int ty, const void *tile)
+{
+    const TileEntry &entry = index[header.tileIndex(level, tx, ty)];
+    return pwrite(fd, tile, entry.size, entry.offset) == (ssize_t)entry.size;
+}
+
+bool TiledHeightmap::open(const string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        cout << "ERROR::HEIGHTMAP::CANNOT_READ: " << path << "\n";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(TiledHeader))
+    {
+        length = info.st_size;
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        data = mapping == MAP_FAILED ? nullptr : (const char *)mapping;
+    }
+    // The mapping stays valid after closing the descriptor
+    ::close(fd);
+
+    header = (const TiledHeader *)data;
+    if (!data || memcmp(header->magic, TILED_MAGIC, 4) != 0 || header->version != TILED_VERSION ||
+        sizeof(TiledHeader) + header->tileCount() * sizeof(TileEntry) > length)
+    {
+        cout << "ERROR::HEIGHTMAP::NOT_TILED: " << path << "\n";
+        close();
+        return false;
+    }
+    index = (const TileEntry *)(data + sizeof(TiledHeader));
+    return true;
+}
+
+void TiledHeightmap::close()
+{
+    if (data)
+        munmap((void *)data, length);
+    data = nullptr;
+    header = nullptr;
+    index = nullptr;
+    length = 0;
+}
+
+const float *TiledHeightmap::getTile(int level, int tx, int ty) const
+{
+    const TileEntry &entry = index[header->tileIndex(level, tx, ty)];
+    if (entry.offset + entry.size > length)
+        return nullptr;
+    return (const float *)(data + entry.offset);
+}
+
+float TiledHeightmap::sample(int level, int x, int y) const
+{
+    int T = header->tileSize;
+    x = max(0, min(x, header->levelWidth(level) - 1));
+    y = max(0, min(y, header->levelHeight(level) - 1));
+    const float *tile = getTile(level, x / T, y / T);
+    return tile ? tile[(y % T) * T + x % T] : 0.0f;
+}
+
+void TiledHeightmap::readRegion(int level, int x, int y, int w, int h, float *out) const
+{
+    int T = header->tileSize;
+    int levelWidth = header->levelWidth(level), levelHeight = header->levelHeight(level);
+    for (int row = 0; row < h; row++)
+    {
+        int gy = max(0, min(y + row, levelHeight - 1));
+        int col = 0;
+        // Copies a run of samples per tile instead of looking each one up
+        while (col < w)
+        {
+            int gx = max(0, min(x + col, levelWidth - 1));
+            int run = (x + col < 0 || x + col >= levelWidth) ? 1 : min(w - col, T - gx % T);
+            const float *tile = getTile(level, gx / T, gy / T);
+            const float *src = tile + (gy % T) * T + gx % T;
+            for (int i = 0; i < run; i++)
+                out[(size_t)row * w + col + i] = tile ? src[i] : 0.0f;
+            col += run;
+        }
+    }
+}
+
+Heightmap TiledHeightmap::readLevel(int level) const
+{
+    Heightmap map;
+    map.width = header->levelWidth(level);
+    map.height = header->levelHeight(level);
+    map.samples.resize((size_t)map.width * map.height);
+    readRegion(level, 0, 0, map.width, map.height, map.samples.data());
+    return map;
+}
+
+int TiledHeightmap::levelFor(int maxSide) const
+{
+    int level = 0;
+    while (level + 1 < (int)header->levels && (header->levelWidth(level) > maxSide || header->levelHeight(level) > maxSide))
+        level++;
+    return level;
+}
@@ -0,0 +1,220 @@
+#include "../include/InteractionRecorder.h"
+
+#include <GLFW/glfw3.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+InteractionState InteractionState::capture(const Terrain &terrain, const Camera &camera)
+{
+    InteractionState state;
+    state.layers = terrain.layers;
+    state.dimension = terrain.dimension;
+    state.frequency = terrain.frequency;
+    state.persistance = terrain.persistance;
+    state.lacunarity = terrain.lacunarity;
+    state.mapHeight = terrain.mapHeight;
+    state.distance = terrain.distance;
+    state.cameraPos = camera.cameraPos;
+    state.cameraFront = camera.cameraFront;
+    state.yaw = camera.getYaw();
+    state.pitch = camera.getPitch();
+    state.preview = terrain.preview;
+    return state;
+}
+
+void InteractionState::apply(Terrain &terrain, Camera &camera) const
+{
+    // The options are applied by checkUpdate like the ones changed from the UI
+    terrain.layers = layers;
+    terrain.dimension = dimension;
+    terrain.frequency = frequency;
+    terrain.persistance = persistance;
+    terrain.lacunarity = lacunarity;
+    terrain.mapHeight = mapHeight;
+    terrain.distance = distance;
+    terrain.preview = preview;
+    if (cameraPos != camera.cameraPos || cameraFront != camera.cameraFront)
+        camera.setLocation(cameraPos, cameraFront, yaw, pitch);
+}
+
+bool InteractionState::operator==(const InteractionState &other) const
+{
+    return layers == other.layers && dimension == other.dimension &&
+           frequency == other.frequency && persistance == other.persistance &&
+           lacunarity == other.lacunarity && mapHeight == other.mapHeight &&
+           distance == other.distance && cameraPos == other.cameraPos &&
+           cameraFront == other.cameraFront && yaw == other.yaw && pitch == other.pitch &&
+           preview == other.preview;
+}
+
+void InteractionRecorder::startRecording(double now, const Terrain &terrain, const Camera &camera)
+{
+    mode = RECORDING;
+    startTime = now;
+    events.clear();
+    // The first event is the starting point of the replay
+    events.push_back({0.0, InteractionState::capture(terrain, camera)});
+}
+
+void InteractionRecorder::record(double now, const Terrain &terrain, const Camera &camera)
+{
+    if (mode != RECORDING)
+        return;
+    InteractionState state = InteractionState::capture(terrain, camera);
+    if (state != events.back().state)
+        events.push_back({now - startTime, state});
+}
+
+bool InteractionRecorder::stopRecording(const string &path)
+{
+    mode = IDLE;
+    ofstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::RECORDER::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    file << "# time layers dimension frequency persistance lacunarity mapHeight distance "
+            "posX posY posZ frontX frontY frontZ yaw pitch preview\n";
+    file << setprecision(9);
+    for (auto &event : events)
+    {
+        const InteractionState &s = event.state;
+        file << event.time << " " << s.layers << " " << s.dimension << " " << s.frequency << " "
+             << s.persistance << " " << s.lacunarity << " " << s.mapHeight << " " << s.distance << " "
+             << s.cameraPos.x << " " << s.cameraPos.y << " " << s.cameraPos.z << " "
+             << s.cameraFront.x << " " << s.cameraFront.y << " " << s.cameraFront.z << " "
+             << s.yaw << " " << s.pitch << " " << s.preview << "\n";
+    }
+    cout << "Recorder: " << events.size() << " events written to " << path << "\n";
+    return true;
+}
+
+bool InteractionRecorder::startReplay(const string &path, double now)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::RECORDER::CANNOT_READ: " << path << "\n";
+        return false;
+    }
+    events.clear();
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream in(line);
+        InteractionEvent event;
+        InteractionState &s = event.state;
+        in >> event.time >> s.layers >> s.dimension >> s.frequency >> s.persistance >> s.lacunarity >> s.mapHeight >> s.distance >> s.cameraPos.x >> s.cameraPos.y >> s.cameraPos.z >> s.cameraFront.x >> s.cameraFront.y >> s.cameraFront.z >> s.yaw >> s.pitch;
+        if (!in)
+        {
+            cout << "ERROR::RECORDER::BAD_LINE: " << line << "\n";
+            return false;
+        }
+        // Recordings made before the preview end at pitch, they never preview
+        int preview = 0;
+        s.preview = (in >> preview) && preview != 0;
+        events.push_back(event);
+    }
+    if (events.empty())
+        return false;
+    mode = REPLAYING;
+    nextEvent = 0;
+    startTime = now;
+    latencies.clear();
+    return true;
+}
+
+bool InteractionRecorder::replay(double now, Terrain &terrain, Camera &camera)
+{
+    if (mode != REPLAYING)
+        return false;
+    bool applied = false;
+    while (nextEvent < events.size() && events[nextEvent].time <= now - startTime)
+    {
+        events[nextEvent].state.apply(terrain, camera);
+        pending.push_back({startTime + events[nextEvent].time, 0});
+        nextEvent++;
+        applied = true;
+    }
+    if (nextEvent == events.size())
+        mode = IDLE;
+    return applied;
+}
+
+double InteractionRecorder::timeToNextEvent(double now) const
+{
+    if (mode != REPLAYING)
+        return INFINITY;
+    return max(0.0, startTime + events[nextEvent].time - now);
+}
+
+void InteractionRecorder::frameSubmitted()
+{
+    // One fence for every change shown by this frame
+    GLsync fence = 0;
+    for (auto &change : pending)
+    {
+        if (change.fence)
+            continue;
+        if (!fence)
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        change.fence = fence;
+    }
+}
+
+void InteractionRecorder::finishFrames()
+{
+    size_t i = 0;
+    while (i < pending.size())
+    {
+        GLsync fence = pending[i].fence;
+        if (!fence)
+        {
+            i++;
+            continue;
+        }
+        // A frame that takes longer is collected after the next one
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_WAIT_TIMEOUT);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            i++;
+            continue;
+        }
+        double now = glfwGetTime();
+        for (auto &change : pending)
+        {
+            if (change.fence == fence)
+                latencies.push_back((now - change.due) * 1000.0);
+        }
+        pending.erase(remove_if(pending.begin(), pending.end(), [fence](const PendingChange &change)
+                                { return change.fence == fence; }),
+                      pending.end());
+        glDeleteSync(fence);
+    }
+}
+
+float InteractionRecorder::percentile(float p) const
+{
+    if (latencies.empty())
+        return 0.0f;
+    vector<float> sorted = latencies;
+    sort(sorted.begin(), sorted.end());
+    // Nearest rank
+    size_t rank = (size_t)ceil(p / 100.0f * sorted.size());
+    return sorted[max(rank, (size_t)1) - 1];
+}
+
+void InteractionRecorder::report(ostream &out) const
+{
+    out << "Replay: " << latencies.size() << " changes, latency p50 " << fixed << setprecision(2)
+        << percentile(50) << " ms, p95 " << percentile(95) << " ms, p99 " << percentile(99)
+        << " ms, max " << percentile(100) << " ms\n";
+}
@@ -0,0 +1,75 @@
+#include "../include/MemoryTracker.h"
+
+#include <algorithm>
+#include <iomanip>
+
+MemoryStats MemoryTracker::stats[MEM_TAG_COUNT];
+mutex MemoryTracker::statsMutex;
+
+void MemoryTracker::allocate(MemoryTag tag, size_t bytes)
+{
+    lock_guard<mutex> lock(statsMutex);
+    MemoryStats &stat = stats[tag];
+    stat.current += bytes;
+    stat.peak = max(stat.peak, stat.current);
+    stat.allocations++;
+    stat.live++;
+}
+
+void MemoryTracker::resize(MemoryTag tag, size_t oldBytes, size_t newBytes)
+{
+    lock_guard<mutex> lock(statsMutex);
+    MemoryStats &stat = stats[tag];
+    stat.current = stat.current - min(stat.current, oldBytes) + newBytes;
+    stat.peak = max(stat.peak, stat.current);
+}
+
+void MemoryTracker::release(MemoryTag tag, size_t bytes)
+{
+    lock_guard<mutex> lock(statsMutex);
+    MemoryStats &stat = stats[tag];
+    stat.current -= min(stat.current, bytes);
+    stat.live--;
+}
+
+MemoryStats MemoryTracker::get(MemoryTag tag)
+{
+    lock_guard<mutex> lock(statsMutex);
+    return stats[tag];
+}
+
+const char *MemoryTracker::getName(MemoryTag tag)
+{
+    switch (tag)
+    {
+    case MEM_HEIGHTMAP:
+        return "heightmap";
+    case MEM_ADJACENCY:
+        return "adjacency";
+    case MEM_VERTEX:
+        return "vertex";
+    case MEM_INDEX:
+        return "index";
+    case MEM_GPU_BUFFERS:
+        return "gpu buffers";
+    case MEM_TEXTURES:
+        return "textures";
+    case MEM_RESULT_CACHE:
+        return "result cache";
+    default:
+        return "unknown";
+    }
+}
+
+void MemoryTracker::report(ostream &out)
+{
+    out << left << setw(12) << "memory" << right << setw(12) << "current KB" << setw(12) << "peak KB"
+        << setw(8) << "allocs" << setw(8) << "live" << "\n";
+    for (int i = 0; i < MEM_TAG_COUNT; i++)
+    {
+        MemoryStats stat = get((MemoryTag)i);
+        out << left << setw(12) << getName((MemoryTag)i) << right << fixed << setprecision(1)
+            << setw(12) << stat.current / 1024.0 << setw(12) << stat.peak / 1024.0
+            << setw(8) << stat.allocations << setw(8) << stat.live << "\n";
+    }
+}
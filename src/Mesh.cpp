@@ -1,37 +1,110 @@
 #include "../include/Mesh.h"
 
-Mesh::Mesh(vector<Vertex> &vertices, vector<GLuint> &indices, vector<Texture> &textures)
+Mesh::Mesh(const vector<Vertex> &vertices, const vector<GLuint> &indices, const vector<Texture> &textures)
 {
-	this->vertices = vertices;
-	this->indices = indices;
+	setVertices(vertices);
+	setIndices(indices);
 	this->textures = textures;
 	setUpMesh();
 }
+
+Mesh::Mesh(vector<Vertex> &&vertices, vector<GLuint> &&indices, vector<Texture> &&textures)
+{
+	this->vertices = move(vertices);
+	this->indices = move(indices);
+	this->textures = move(textures);
+	setUpMesh();
+}
+
+void Mesh::setVertices(const vector<Vertex> &_vertices)
+{
+	copiedBytes += _vertices.size() * sizeof(Vertex);
+	vertices = _vertices;
+}
+
+void Mesh::setIndices(const vector<GLuint> &_indices)
+{
+	copiedBytes += _indices.size() * sizeof(GLuint);
+	indices = _indices;
+}
 void Mesh::setUpMesh()
 {
+	ProfileScope scope("Mesh setup", true, {{"vertices", vertices.size()}, {"indices", indices.size()}});
 	this->VAO1.Bind();
-	// Generates Vertex Buffer Object and links it to vertices
-	VBO VBO(vertices);
-	// Generates Element Buffer Object and links it to indices
-	EBO EBO(indices);
-	// Links VBO attributes such as coordinates and colors to VAO
-	this->VAO1.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void *)0);
-	// VAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(3 * sizeof(float))); // Color is not used
-	this->VAO1.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(offsetof(Vertex, normal)));
-	this->VAO1.LinkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void *)(offsetof(Vertex, color)));
+	// Links the indices to the VAO, the same buffer is refilled on every call
+	EBO1.update(indices);
+	if (streams.empty())
+	{
+		// The bounds are taken while the vertices are being uploaded
+		BoundingBox box;
+		for (auto &vertex : vertices)
+			box.expand(vertex.position);
+		setBounds(box);
+
+		// Uploads the vertices to the mesh's Vertex Buffer Object
+		VBO1.update(vertices);
+		// Links VBO attributes such as coordinates and colors to VAO
+		this->VAO1.LinkAttrib(VBO1, 0, 3, GL_FLOAT, sizeof(Vertex), (void *)0);
+		// VAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(3 * sizeof(float))); // Color is not used
+		this->VAO1.LinkAttrib(VBO1, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(offsetof(Vertex, normal)));
+		this->VAO1.LinkAttrib(VBO1, 2, 2, GL_FLOAT, sizeof(Vertex), (void *)(offsetof(Vertex, texCoords)));
+	}
+	else
+	{
+		// Every stream is tightly packed in its own buffer
+		for (auto &stream : streams)
+		{
+			stream.buffer.update(stream.data);
+			this->VAO1.LinkAttrib(stream.buffer, stream.layout, stream.numComponents, GL_FLOAT, stream.numComponents * sizeof(GLfloat), (void *)0);
+			stream.dirty = false;
+		}
+	}
 
 	// Unbind all to prevent accidentally modifying them
 	this->VAO1.Unbind();
-	VBO.Unbind();
-	EBO.Unbind();
+	EBO1.Unbind();
 }
 
-void Mesh::Draw(Shader &shader)
+void Mesh::Delete()
 {
-	// Bind shader to be able to access uniforms
-	shader.Activate();
-	this->VAO1.Bind();
+	VAO1.Delete();
+	VBO1.Delete();
+	EBO1.Delete();
+	for (auto &stream : streams)
+		stream.buffer.Delete();
+}
+
+void Mesh::setBounds(const BoundingBox &box)
+{
+	boundingBox = box;
+	boundingSphere = BoundingSphere(box);
+}
 
+GLuint Mesh::addStream(GLuint layout, GLuint numComponents)
+{
+	VertexStream stream;
+	stream.layout = layout;
+	stream.numComponents = numComponents;
+	streams.push_back(stream);
+	return streams.size() - 1;
+}
+
+void Mesh::updateStreams()
+{
+	ProfileScope scope("Upload", true);
+	// The VAO already points to the buffers, only their content changes
+	for (auto &stream : streams)
+	{
+		if (!stream.dirty)
+			continue;
+		stream.buffer.update(stream.data);
+		stream.buffer.Unbind();
+		stream.dirty = false;
+	}
+}
+
+void Mesh::resolveTextureUniforms(Shader &shader)
+{
 	// Keep track of how many of each type of textures we have
 	unsigned int numDiffuse = 0;
 	unsigned int numSpecular = 0;
@@ -44,6 +117,7 @@ void Mesh::Draw(Shader &shader)
 	material.specular0
 	material.specular1
 	*/
+	textureUniforms.clear();
 	for (unsigned int i = 0; i < this->textures.size(); i++)
 	{
 		string num;
@@ -56,8 +130,32 @@ void Mesh::Draw(Shader &shader)
 		{
 			num = to_string(numSpecular++);
 		}
+		textureUniforms.push_back(shader.getUniform<int>("material." + (type + num)));
+	}
+	texturesShader = shader.ID;
+}
+
+ShaderFeatures Mesh::getFeatures(ShaderFeatures lighting)
+{
+	// Meshes without textures are colored with the terrain palette
+	lighting.textures = !textures.empty();
+	lighting.terrainColors = textures.empty();
+	return lighting;
+}
+
+void Mesh::Draw(Shader &shader)
+{
+	// Bind shader to be able to access uniforms
+	shader.Activate();
+	this->VAO1.Bind();
+
+	if (shader.ID != texturesShader || textureUniforms.size() != textures.size())
+		resolveTextureUniforms(shader);
+
+	for (unsigned int i = 0; i < this->textures.size(); i++)
+	{
 		// Exports the textures to the shader
-		textures[i].texUnit(shader, ("material." + (type + num)).c_str(), i);
+		textureUniforms[i].set(i);
 		textures[i].Bind();
 	}
 
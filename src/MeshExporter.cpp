@@ -0,0 +1,371 @@
+#include "../include/MeshExporter.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <iomanip>
+
+size_t MeshExporter::workingSet = 0;
+
+HeightSource HeightSource::fromHeightmap(const Heightmap &map)
+{
+    HeightSource source;
+    source.width = map.width;
+    source.height = map.height;
+    source.read = [&map](int x, int y, int w, int h, float *out)
+    {
+        for (int row = 0; row < h; row++)
+        {
+            int my = max(0, min(y + row, map.height - 1));
+            for (int col = 0; col < w; col++)
+                out[row * w + col] = map.at(max(0, min(x + col, map.width - 1)), my);
+        }
+    };
+    return source;
+}
+
+HeightSource HeightSource::fromTiled(const TiledHeightmap &tiled, int level)
+{
+    HeightSource source;
+    source.width = tiled.getHeader().levelWidth(level);
+    source.height = tiled.getHeader().levelHeight(level);
+    source.read = [&tiled, level](int x, int y, int w, int h, float *out)
+    { tiled.readRegion(level, x, y, w, h, out); };
+    return source;
+}
+
+bool BufferedWriter::open(const string &path)
+{
+    file = fopen(path.c_str(), "wb");
+    used = 0;
+    written = 0;
+    failed = file == nullptr;
+    if (failed)
+        cout << "ERROR::EXPORT::CANNOT_WRITE: " << path << "\n";
+    return !failed;
+}
+
+void BufferedWriter::write(const void *data, size_t bytes)
+{
+    const char *p = (const char *)data;
+    while (bytes > 0)
+    {
+        size_t chunk = min(bytes, buffer.size() - used);
+        memcpy(&buffer[used], p, chunk);
+        used += chunk;
+        p += chunk;
+        bytes -= chunk;
+        written += chunk;
+        if (used == buffer.size())
+            flush();
+    }
+}
+
+void BufferedWriter::flush()
+{
+    if (file && used > 0 && fwrite(buffer.data(), 1, used, file) != used)
+        failed = true;
+    used = 0;
+}
+
+bool BufferedWriter::close()
+{
+    if (!file)
+        return !failed;
+    flush();
+    failed |= fclose(file) != 0;
+    file = nullptr;
+    return !failed;
+}
+
+bool MeshExporter::checkSize(const HeightSource &source)
+{
+    // The indices are 32 bit in both formats
+    if (source.width < 2 || source.height < 2 || (uint64_t)source.width * source.height > UINT32_MAX)
+    {
+        cout << "ERROR::EXPORT::BAD_SIZE: " << source.width << " x " << source.height << "\n";
+        return false;
+    }
+    return true;
+}
+
+MeshExporter::Bounds MeshExporter::getBounds(const HeightSource &source, const MeshExportOptions &options)
+{
+    // The heights need a pass over the map, a tile at a time
+    int T = options.tileSize;
+    vector<float> tile(T * T);
+    float low = INFINITY, high = -INFINITY;
+    for (int y0 = 0; y0 < source.height; y0 += T)
+    {
+        for (int x0 = 0; x0 < source.width; x0 += T)
+        {
+            int w = min(T, source.width - x0), h = min(T, source.height - y0);
+            source.read(x0, y0, w, h, tile.data());
+            for (int i = 0; i < w * h; i++)
+            {
+                low = min(low, tile[i]);
+                high = max(high, tile[i]);
+            }
+        }
+    }
+    Bounds bounds = {{0.0f, 1.0f + low * options.mapHeight, 0.0f},
+                     {(source.width - 1) * options.distance, 1.0f + high * options.mapHeight, (source.height - 1) * options.distance}};
+    return bounds;
+}
+
+uint32_t MeshExporter::vertexIndex(const HeightSource &source, int tileSize, int x, int y)
+{
+    // The vertices are written tile by tile, a full row of tiles holds tileSize rows of samples
+    int tx = x / tileSize, ty = y / tileSize;
+    int rows = min(tileSize, source.height - ty * tileSize);
+    int cols = min(tileSize, source.width - tx * tileSize);
+    uint64_t base = (uint64_t)ty * tileSize * source.width + (uint64_t)tx * tileSize * rows;
+    return base + (y - ty * tileSize) * cols + (x - tx * tileSize);
+}
+
+void MeshExporter::writeVertices(BufferedWriter &out, const HeightSource &source, const MeshExportOptions &options, const Bounds &bounds)
+{
+    int T = options.tileSize;
+    // One sample of apron on every side for the normals
+    int A = T + 2;
+    vector<float> tile(A * A);
+    workingSet = out.getCapacity() + tile.size() * sizeof(float);
+
+    float scale[3];
+    for (int i = 0; i < 3; i++)
+        scale[i] = bounds.max[i] > bounds.min[i] ? 65535.0f / (bounds.max[i] - bounds.min[i]) : 0.0f;
+
+    for (int y0 = 0; y0 < source.height; y0 += T)
+    {
+        for (int x0 = 0; x0 < source.width; x0 += T)
+        {
+            int w = min(T, source.width - x0), h = min(T, source.height - y0);
+            source.read(x0 - 1, y0 - 1, w + 2, h + 2, tile.data());
+            for (int y = 0; y < h; y++)
+            {
+                for (int x = 0; x < w; x++)
+                {
+                    auto at = [&](int dx, int dy)
+                    { return tile[(y + 1 + dy) * (w + 2) + x + 1 + dx] * options.mapHeight; };
+                    float pos[3] = {(x0 + x) * options.distance, 1.0f + at(0, 0), (y0 + y) * options.distance};
+                    // Central differences of the scaled surface
+                    float nx = -(at(1, 0) - at(-1, 0)) / (2.0f * options.distance);
+                    float nz = -(at(0, 1) - at(0, -1)) / (2.0f * options.distance);
+                    float length = sqrt(nx * nx + 1.0f + nz * nz);
+                    float normal[3] = {nx / length, 1.0f / length, nz / length};
+
+                    if (!options.quantize)
+                    {
+                        out.write(pos, sizeof(pos));
+                        out.write(normal, sizeof(normal));
+                        continue;
+                    }
+                    // 4 byte aligned records: 3 x uint16 + pad, 3 x int8 + pad
+                    uint16_t qpos[4] = {0, 0, 0, 0};
+                    int8_t qnormal[4] = {0, 0, 0, 0};
+                    for (int i = 0; i < 3; i++)
+                    {
+                        qpos[i] = (uint16_t)lround((pos[i] - bounds.min[i]) * scale[i]);
+                        qnormal[i] = (int8_t)lround(normal[i] * 127.0f);
+                    }
+                    out.write(qpos, sizeof(qpos));
+                    out.write(qnormal, sizeof(qnormal));
+                }
+            }
+        }
+    }
+}
+
+void MeshExporter::writeTriangles(BufferedWriter &out, const HeightSource &source, const MeshExportOptions &options, bool prefix)
+{
+    int T = options.tileSize;
+    unsigned char count = 3;
+    // The cells are walked in the same tiles, only the indices are computed
+    for (int y0 = 0; y0 < source.height - 1; y0 += T)
+    {
+        for (int x0 = 0; x0 < source.width - 1; x0 += T)
+        {
+            int w = min(T, source.width - 1 - x0), h = min(T, source.height - 1 - y0);
+            for (int y = y0; y < y0 + h; y++)
+            {
+                for (int x = x0; x < x0 + w; x++)
+                {
+                    uint32_t a = vertexIndex(source, T, x, y), b = vertexIndex(source, T, x + 1, y);
+                    uint32_t c = vertexIndex(source, T, x, y + 1), d = vertexIndex(source, T, x + 1, y + 1);
+                    // Counter-clockwise seen from +Y, the side the normals point to
+                    uint32_t first[3] = {a, c, b}, second[3] = {b, c, d};
+                    if (prefix)
+                        out.write(&count, 1);
+                    out.write(first, sizeof(first));
+                    if (prefix)
+                        out.write(&count, 1);
+                    out.write(second, sizeof(second));
+                }
+            }
+        }
+    }
+}
+
+bool MeshExporter::writePLY(const string &path, const HeightSource &source, const MeshExportOptions &options)
+{
+    if (!checkSize(source))
+        return false;
+    Bounds bounds = getBounds(source, options);
+    uint64_t vertices = (uint64_t)source.width * source.height;
+    uint64_t faces = 2 * (uint64_t)(source.width - 1) * (source.height - 1);
+
+    BufferedWriter out;
+    if (!out.open(path))
+        return false;
+    ostringstream header;
+    header << "ply\nformat binary_little_endian 1.0\n"
+           << "comment Terrain-generator heightmap " << source.width << " x " << source.height << "\n";
+    if (options.quantize)
+    {
+        header << "comment quantized: position = min + value * (max - min) / 65535, normal = value / 127\n";
+        for (int i = 0; i < 3; i++)
+            header << "comment axis " << i << " min " << bounds.min[i] << " max " << bounds.max[i] << "\n";
+        header << "element vertex " << vertices << "\n"
+               << "property ushort x\nproperty ushort y\nproperty ushort z\nproperty ushort pad0\n"
+               << "property char nx\nproperty char ny\nproperty char nz\nproperty char pad1\n";
+    }
+    else
+    {
+        header << "element vertex " << vertices << "\n"
+               << "property float x\nproperty float y\nproperty float z\n"
+               << "property float nx\nproperty float ny\nproperty float nz\n";
+    }
+    header << "element face " << faces << "\nproperty list uchar uint vertex_indices\nend_header\n";
+    string text = header.str();
+    out.write(text.data(), text.size());
+
+    writeVertices(out, source, options, bounds);
+    writeTriangles(out, source, options, true);
+    return out.close();
+}
+
+bool MeshExporter::writeGLTF(const string &path, const HeightSource &source, const MeshExportOptions &options)
+{
+    if (!checkSize(source))
+        return false;
+    Bounds bounds = getBounds(source, options);
+    uint64_t vertices = (uint64_t)source.width * source.height;
+    uint64_t indices = 6 * (uint64_t)(source.width - 1) * (source.height - 1);
+    int stride = options.quantize ? 12 : 24;
+
+    // The binary buffer is streamed first, the JSON only needs the sizes
+    string binPath = path.substr(0, path.find_last_of('.')) + ".bin";
+    BufferedWriter out;
+    if (!out.open(binPath))
+        return false;
+    writeVertices(out, source, options, bounds);
+    uint64_t vertexBytes = out.getWritten();
+    writeTriangles(out, source, options, false);
+    uint64_t totalBytes = out.getWritten();
+    if (!out.close())
+        return false;
+
+    ofstream json(path);
+    if (!json)
+    {
+        cout << "ERROR::EXPORT::CANNOT_WRITE: " << path << "\n";
+        return false;
+    }
+    string binName = binPath.substr(binPath.find_last_of('/') + 1);
+    json << setprecision(9);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Terrain-generator\"},";
+    if (options.quantize)
+        json << "\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"],";
+    json << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0";
+    float qmax[3];
+    if (options.quantize)
+    {
+        // The node transform turns the 16 bit positions back into model space
+        json << ",\"translation\":[" << bounds.min[0] << "," << bounds.min[1] << "," << bounds.min[2] << "],\"scale\":[";
+        for (int i = 0; i < 3; i++)
+        {
+            float range = bounds.max[i] - bounds.min[i];
+            json << (i ? "," : "") << (range > 0.0f ? range / 65535.0f : 1.0f);
+            qmax[i] = range > 0.0f ? 65535.0f : 0.0f;
+        }
+        json << "]";
+    }
+    json << "}],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2}]}],"
+         << "\"buffers\":[{\"uri\":\"" << binName << "\",\"byteLength\":" << totalBytes << "}],"
+         << "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertexBytes << ",\"byteStride\":" << stride << ",\"target\":34962},"
+         << "{\"buffer\":0,\"byteOffset\":" << vertexBytes << ",\"byteLength\":" << totalBytes - vertexBytes << ",\"target\":34963}],"
+         << "\"accessors\":[";
+    if (options.quantize)
+        json << "{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5123,\"count\":" << vertices << ",\"type\":\"VEC3\",\"min\":[0,0,0],\"max\":["
+             << qmax[0] << "," << qmax[1] << "," << qmax[2] << "]},"
+             << "{\"bufferView\":0,\"byteOffset\":8,\"componentType\":5120,\"normalized\":true,\"count\":" << vertices << ",\"type\":\"VEC3\"},";
+    else
+        json << "{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":" << vertices << ",\"type\":\"VEC3\",\"min\":["
+             << bounds.min[0] << "," << bounds.min[1] << "," << bounds.min[2] << "],\"max\":["
+             << bounds.max[0] << "," << bounds.max[1] << "," << bounds.max[2] << "]},"
+             << "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":" << vertices << ",\"type\":\"VEC3\"},";
+    json << "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":" << indices << ",\"type\":\"SCALAR\"}]}\n";
+    return (bool)json;
+}
+
+bool MeshExporter::checkWinding(const string &path, uint64_t &flipped)
+{
+    ifstream file(path, ios::binary);
+    uint64_t vertices = 0, faces = 0;
+    bool quantized = false;
+    string line;
+    while (getline(file, line) && line != "end_header")
+    {
+        istringstream in(line);
+        string word, element;
+        in >> word;
+        if (word == "element")
+            in >> element >> (element == "vertex" ? vertices : faces);
+        else if (word == "property")
+            quantized |= line.find("ushort") != string::npos;
+    }
+    if (!file || quantized)
+    {
+        cout << "ERROR::EXPORT::BAD_PLY: " << path << " (only float PLY files are checked)\n";
+        return false;
+    }
+
+    // x y z nx ny nz per vertex, then a count and 3 indices per face
+    vector<float> records(vertices * 6);
+    file.read((char *)records.data(), records.size() * sizeof(float));
+    flipped = 0;
+    uint64_t i = 0;
+    for (; i < faces; i++)
+    {
+        unsigned char count = 0;
+        uint32_t index[3];
+        file.read((char *)&count, 1);
+        file.read((char *)index, sizeof(index));
+        if (!file || count != 3 || index[0] >= vertices || index[1] >= vertices || index[2] >= vertices)
+            break;
+        const float *p[3] = {&records[index[0] * 6], &records[index[1] * 6], &records[index[2] * 6]};
+        float e1[3], e2[3];
+        for (int k = 0; k < 3; k++)
+        {
+            e1[k] = p[1][k] - p[0][k];
+            e2[k] = p[2][k] - p[0][k];
+        }
+        float face[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        // The surface is a height field, the side a normal faces is the sign of its Y.
+        // A full dot product fails where the slope changes faster than the sampling
+        bool agrees = true;
+        for (int v = 0; v < 3; v++)
+            agrees &= (face[1] > 0.0f) == (p[v][4] > 0.0f);
+        if (!agrees)
+            flipped++;
+    }
+    if (i < faces)
+    {
+        cout << "ERROR::EXPORT::BAD_PLY: " << path << " (bad face " << i << ")\n";
+        return false;
+    }
+    return true;
+}
@@ -6,6 +6,20 @@ void Model::Draw(Shader &shader)
         meshes[i].Draw(shader);
 }
 
+BoundingBox Model::getBoundingBox()
+{
+    BoundingBox box;
+    for (auto &mesh : meshes)
+        box.merge(mesh.boundingBox);
+    return box;
+}
+
+void Model::Draw(ShaderVariants &shaders, const ShaderFeatures &lighting)
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].Draw(shaders.get(meshes[i].getFeatures(lighting)));
+}
+
 void Model::loadModel(string path)
 {
     Assimp::Importer import;
@@ -94,7 +108,7 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
         vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "specular", (unsigned int)textures.size());
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
     }
-    return Mesh(vertices, indices, textures);
+    return Mesh(move(vertices), move(indices), move(textures));
 }
 
 vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, GLuint slotNumber)
@@ -0,0 +1,147 @@
+#include "../include/Profiler.h"
+
+#include <algorithm>
+
+bool Profiler::enabled = true;
+vector<ProfileStage> Profiler::stages;
+vector<Profiler::OpenStage> Profiler::stack;
+unsigned int Profiler::frame = 0;
+bool Profiler::recording = false;
+bool Profiler::gpuActive = false;
+
+void Profiler::beginFrame()
+{
+    recording = enabled;
+    if (!recording)
+        return;
+    frame++;
+    // The slot about to be reused holds the queries of GPU_QUERY_FRAMES frames ago
+    int slot = frame % GPU_QUERY_FRAMES;
+    for (auto &stage : stages)
+    {
+        collectQueries(stage, slot, frame - GPU_QUERY_FRAMES);
+        stage.cpuFrame = 0.0f;
+    }
+}
+
+void Profiler::endFrame()
+{
+    if (!recording)
+        return;
+    // Close anything left open so the next frame starts at the top level
+    while (!stack.empty())
+        end(stack.back().stage);
+
+    int index = frame % PROFILER_HISTORY;
+    for (auto &stage : stages)
+    {
+        stage.cpuHistory[index] = stage.cpuFrame;
+        stage.cpuAvg = stage.cpuMax = 0.0f;
+        stage.gpuAvg = stage.gpuMax = 0.0f;
+        for (int i = 0; i < PROFILER_HISTORY; i++)
+        {
+            stage.cpuAvg += stage.cpuHistory[i];
+            stage.cpuMax = max(stage.cpuMax, stage.cpuHistory[i]);
+            stage.gpuAvg += stage.gpuHistory[i];
+            stage.gpuMax = max(stage.gpuMax, stage.gpuHistory[i]);
+        }
+        stage.cpuAvg /= PROFILER_HISTORY;
+        stage.gpuAvg /= PROFILER_HISTORY;
+    }
+    recording = false;
+}
+
+int Profiler::begin(const char *name, bool gpu, initializer_list<TraceArg> args)
+{
+    Trace::begin(name, args);
+    if (!recording)
+        return -1;
+    int parent = stack.empty() ? -1 : stack.back().stage;
+    int index = findStage(name, parent);
+
+    bool gpuQuery = gpu && !gpuActive;
+    if (gpuQuery)
+    {
+        ProfileStage &stage = stages[index];
+        int slot = frame % GPU_QUERY_FRAMES;
+        if (stage.usedQueries[slot] == stage.queries[slot].size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            stage.queries[slot].push_back(query);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, stage.queries[slot][stage.usedQueries[slot]++]);
+        stage.gpu = true;
+        gpuActive = true;
+    }
+    stack.push_back({index, chrono::steady_clock::now(), gpuQuery});
+    return index;
+}
+
+void Profiler::end(int stage)
+{
+    Trace::end();
+    if (stage < 0 || stack.empty())
+        return;
+    OpenStage open = stack.back();
+    stack.pop_back();
+    chrono::duration<float, milli> elapsed = chrono::steady_clock::now() - open.start;
+    stages[open.stage].cpuFrame += elapsed.count();
+    if (open.gpuQuery)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuActive = false;
+    }
+}
+
+int Profiler::findStage(const char *name, int parent)
+{
+    for (unsigned int i = 0; i < stages.size(); i++)
+    {
+        if (stages[i].parent == parent && stages[i].name == name)
+            return i;
+    }
+    ProfileStage stage;
+    stage.name = name;
+    stage.parent = parent;
+    stage.depth = parent < 0 ? 0 : stages[parent].depth + 1;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+void Profiler::collectQueries(ProfileStage &stage, int slot, unsigned int issuedFrame)
+{
+    if (stage.usedQueries[slot] == 0)
+    {
+        stage.gpuHistory[issuedFrame % PROFILER_HISTORY] = 0.0f;
+        return;
+    }
+    GLuint64 total = 0;
+    for (unsigned int i = 0; i < stage.usedQueries[slot]; i++)
+    {
+        // Not ready after GPU_QUERY_FRAMES frames means the GPU is far behind, skip it instead of waiting
+        GLint available = 0;
+        glGetQueryObjectiv(stage.queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(stage.queries[slot][i], GL_QUERY_RESULT, &elapsed);
+        total += elapsed;
+    }
+    stage.gpuHistory[issuedFrame % PROFILER_HISTORY] = total / 1.0e6f;
+    stage.usedQueries[slot] = 0;
+}
+
+void Profiler::Delete()
+{
+    for (auto &stage : stages)
+    {
+        for (int slot = 0; slot < GPU_QUERY_FRAMES; slot++)
+        {
+            if (!stage.queries[slot].empty())
+                glDeleteQueries(stage.queries[slot].size(), stage.queries[slot].data());
+        }
+    }
+    stages.clear();
+    stack.clear();
+}
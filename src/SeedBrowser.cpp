@@ -0,0 +1,131 @@
+#include "../include/SeedBrowser.h"
+#include "../include/Trace.h"
+
+#include <random>
+#include <chrono>
+
+// Same lookup as CalcBandColor in default.frag
+static uint32_t bandColor(const vector<ColorBand> &palette, float noise)
+{
+    glm::vec3 color(0.0f);
+    int numBands = min((int)palette.size(), MAX_COLOR_BANDS);
+    for (int i = 0; i < numBands; i++)
+    {
+        color = palette[i].color;
+        if (noise < palette[i].threshold)
+            break;
+    }
+    color = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return (uint32_t)color.r | (uint32_t)color.g << 8 | (uint32_t)color.b << 16 | 0xff000000u;
+}
+
+SeedBrowser::~SeedBrowser()
+{
+    stop();
+}
+
+void SeedBrowser::start(Terrain &terrain, int count)
+{
+    stop();
+    Delete();
+
+    // The thumbnail is the whole map with fewer samples, it looks like the full one
+    options = GenerationOptions();
+    options.size = SEED_THUMBNAIL_SIDE;
+    options.layers = terrain.layers;
+    options.frequency = terrain.frequency;
+    options.persistance = terrain.persistance;
+    options.lacunarity = terrain.lacunarity;
+
+    random_device seeds;
+    thumbnails.clear();
+    for (int i = 0; i < count; i++)
+    {
+        thumbnails.push_back(make_unique<SeedThumbnail>());
+        thumbnails.back()->seed = seeds();
+    }
+    next = 0;
+    finished = 0;
+    cancelled = false;
+    startTime = now();
+    endTime = 0.0;
+    int threads = max(1, min(terrain.threads, count));
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&SeedBrowser::work, this);
+}
+
+void SeedBrowser::stop()
+{
+    cancelled = true;
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void SeedBrowser::work()
+{
+    // Takes the next seed until the batch is done, each one is independent of the others
+    for (int i = next++; i < size() && !cancelled; i = next++)
+    {
+        SeedThumbnail &thumbnail = *thumbnails[i];
+        TraceScope trace("Seed thumbnail", {{"index", i}});
+        GenerationOptions seedOptions = options;
+        seedOptions.seed = thumbnail.seed;
+        TileGenerator generator(seedOptions);
+        thumbnail.noise.resize(SEED_THUMBNAIL_SIDE * SEED_THUMBNAIL_SIDE);
+        generator.generateRegion(0, 0, SEED_THUMBNAIL_SIDE, SEED_THUMBNAIL_SIDE, thumbnail.noise.data());
+        thumbnail.ready = true;
+        if (++finished == size())
+            endTime = now();
+    }
+}
+
+void SeedBrowser::upload(const vector<ColorBand> &palette)
+{
+    vector<uint32_t> pixels(SEED_THUMBNAIL_SIDE * SEED_THUMBNAIL_SIDE);
+    for (auto &thumbnail : thumbnails)
+    {
+        if (thumbnail->texture || !thumbnail->ready)
+            continue;
+        for (size_t i = 0; i < pixels.size(); i++)
+            pixels[i] = bandColor(palette, thumbnail->noise[i]);
+        glGenTextures(1, &thumbnail->texture);
+        glBindTexture(GL_TEXTURE_2D, thumbnail->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SEED_THUMBNAIL_SIDE, SEED_THUMBNAIL_SIDE, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        MemoryTracker::allocate(MEM_TEXTURES, pixels.size() * 4);
+    }
+}
+
+void SeedBrowser::recolor()
+{
+    // The noise is kept, the next upload colors it with the new palette
+    Delete();
+}
+
+void SeedBrowser::Delete()
+{
+    for (auto &thumbnail : thumbnails)
+    {
+        if (!thumbnail->texture)
+            continue;
+        glDeleteTextures(1, &thumbnail->texture);
+        thumbnail->texture = 0;
+        MemoryTracker::release(MEM_TEXTURES, SEED_THUMBNAIL_SIDE * SEED_THUMBNAIL_SIDE * 4);
+    }
+}
+
+float SeedBrowser::getThroughput()
+{
+    double elapsed = (isRunning() ? now() : endTime.load()) - startTime;
+    return elapsed > 0.0 ? finished / elapsed : 0.0f;
+}
+
+double SeedBrowser::now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
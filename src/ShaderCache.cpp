@@ -0,0 +1,140 @@
+#include "../include/ShaderCache.h"
+#include <GLFW/glfw3.h>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Not part of the GL 3.3 loader, the entry points are loaded by hand
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void(APIENTRYP GetProgramBinaryFn)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void(APIENTRYP ProgramBinaryFn)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void(APIENTRYP ProgramParameteriFn)(GLuint program, GLenum pname, GLint value);
+
+static GetProgramBinaryFn getProgramBinary = nullptr;
+static ProgramBinaryFn programBinary = nullptr;
+static ProgramParameteriFn programParameteri = nullptr;
+
+// Header of the cache files
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+    float compileMs;
+};
+const uint32_t CACHE_VERSION = 1;
+
+// FNV-1a, stable between runs unlike std::hash
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static string cachePath(const string &name)
+{
+    return string(SHADER_CACHE_DIR) + "/" + name + ".bin";
+}
+
+bool ShaderCache::isSupported()
+{
+    static int supported = -1;
+    if (supported == -1)
+    {
+        getProgramBinary = (GetProgramBinaryFn)glfwGetProcAddress("glGetProgramBinary");
+        programBinary = (ProgramBinaryFn)glfwGetProcAddress("glProgramBinary");
+        programParameteri = (ProgramParameteriFn)glfwGetProcAddress("glProgramParameteri");
+        GLint numFormats = 0;
+        if (getProgramBinary && programBinary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        supported = numFormats > 0;
+    }
+    return supported;
+}
+
+uint64_t ShaderCache::getKey(const string &vertexCode, const string &fragmentCode)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, vertexCode.data(), vertexCode.size());
+    hash = hashBytes(hash, fragmentCode.data(), fragmentCode.size());
+    // A driver update invalidates the binaries
+    const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum str : driverStrings)
+    {
+        const char *value = (const char *)glGetString(str);
+        if (value)
+            hash = hashBytes(hash, value, string(value).size());
+    }
+    return hash;
+}
+
+void ShaderCache::setRetrievable(GLuint program)
+{
+    if (isSupported() && programParameteri)
+        programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ShaderCache::load(GLuint program, const string &name, uint64_t key, float &compileMs)
+{
+    if (!isSupported())
+        return false;
+    ifstream in(cachePath(name), ios::binary);
+    if (!in)
+        return false;
+
+    CacheHeader header;
+    if (!in.read((char *)&header, sizeof(header)) || string(header.magic, 4) != "SHBC" ||
+        header.version != CACHE_VERSION || header.key != key)
+        return false;
+    vector<char> binary(header.length);
+    if (!in.read(binary.data(), binary.size()))
+        return false;
+
+    programBinary(program, header.format, binary.data(), header.length);
+    // The driver can still reject a binary it produced before
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    compileMs = header.compileMs;
+    return linked == GL_TRUE;
+}
+
+void ShaderCache::save(GLuint program, const string &name, uint64_t key, float compileMs)
+{
+    if (!isSupported())
+        return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    CacheHeader header = {{'S', 'H', 'B', 'C'}, CACHE_VERSION, key, 0, 0, compileMs};
+    vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    getProgramBinary(program, length, &written, &format, binary.data());
+    header.format = format;
+    header.length = written;
+
+    error_code error;
+    filesystem::create_directories(SHADER_CACHE_DIR, error);
+    ofstream out(cachePath(name), ios::binary | ios::trunc);
+    if (!out)
+        return;
+    out.write((const char *)&header, sizeof(header));
+    out.write(binary.data(), written);
+}
@@ -0,0 +1,28 @@
+#include "../include/ShaderVariants.h"
+
+ShaderVariants::ShaderVariants(const char *vertexFile, const char *fragmentFile) : vertexFile(vertexFile), fragmentFile(fragmentFile)
+{
+}
+
+Shader &ShaderVariants::get(const ShaderFeatures &features)
+{
+    auto it = variants.find(features.key());
+    if (it != variants.end())
+        return it->second;
+
+    // unordered_map keeps the references valid when it grows
+    Shader &shader = variants.emplace(features.key(), Shader(vertexFile.c_str(), fragmentFile.c_str(), features)).first->second;
+    if (onBuild)
+    {
+        shader.Activate();
+        onBuild(shader);
+    }
+    return shader;
+}
+
+void ShaderVariants::Delete()
+{
+    for (auto &variant : variants)
+        variant.second.Delete();
+    variants.clear();
+}
@@ -1,4 +1,6 @@
 #include "../include/Terrain.h"
+#include <thread>
+#include <chrono>
 
 struct Default
 {
@@ -24,8 +26,32 @@ struct TerrainColors
     glm::vec3 snow = glm::vec3(255, 250, 250) / 256.0f;
 } terrainColors;
 
-Terrain::Terrain(int _width, int _height) : width(_width), height(_height)
+// std140 layout of the ColorBands block
+// The block size is rounded up to a multiple of a vec4
+struct ColorBandsBlock
 {
+    ColorBand bands[MAX_COLOR_BANDS];
+    GLint numBands;
+    GLint pad[3];
+};
+static_assert(sizeof(ColorBandsBlock) == 144, "ColorBandsBlock must follow the std140 layout");
+
+Terrain::Terrain(int _width, int _height) : colorBandsUBO(sizeof(ColorBandsBlock), COLOR_BANDS_BINDING), width(_width), height(_height)
+{
+    // Separate buffers so each slider only re-uploads what it changes (see default.vert)
+    gridStream = terrainMesh.addStream(0, 2);
+    normalStream = terrainMesh.addStream(1, 3);
+    heightStream = terrainMesh.addStream(2, 1);
+
+    // Buffers reused by every regeneration
+    pool.track("heightmap", terrainPos);
+    pool.track("adjacency", commonVert);
+    pool.track("adjacency count", commonCount);
+    pool.track("grid stream", terrainMesh.streamData(gridStream));
+    pool.track("normal stream", terrainMesh.streamData(normalStream));
+    pool.track("height stream", terrainMesh.streamData(heightStream));
+    pool.track("indices", terrainMesh.indices);
+
     frequency = defaultValue.frequency;
     lacunarity = defaultValue.lacunarity;
     persistance = defaultValue.persistance;
@@ -46,8 +72,12 @@ Terrain::Terrain(int _width, int _height) : width(_width), height(_height)
     lastWidth = width;
     lastHeight = height;
     lastDimension = dimension;
+    lastLayers = layers;
+
+    threads = max(1u, thread::hardware_concurrency());
+
+    resetColorBands();
 
-    srand(time(0));
     resetSeed();
     resetOptions();
     terrainMesh.setUpMesh();
@@ -55,53 +85,156 @@ Terrain::Terrain(int _width, int _height) : width(_width), height(_height)
 
 void Terrain::drawTerrain(Shader &shader)
 {
+    // The vertices are stored unscaled, the shader applies the spacing and the height
+    shader.Activate();
+    if (shader.ID != uniformsShader)
+    {
+        mapHeightUniform = shader.getUniform<float>("mapHeight");
+        gridDistanceUniform = shader.getUniform<float>("gridDistance");
+        uniformsShader = shader.ID;
+    }
+    mapHeightUniform.set(mapHeight);
+    gridDistanceUniform.set(distance);
     terrainMesh.Draw(shader);
 }
 
-void Terrain::checkUpdate()
+void Terrain::Delete()
 {
+    finishRefine(true);
+    terrainMesh.Delete();
+    colorBandsUBO.Delete();
+}
+
+bool Terrain::checkUpdate()
+{
+    ProfileScope scope("Terrain update");
+    bool changed = false;
+    // The background noise is done, the full mesh replaces the preview
+    if (refineTask.valid() && refineTask.wait_for(chrono::seconds(0)) == future_status::ready)
+    {
+        finishRefine(false);
+        changed = true;
+    }
+    if (lastFreq != frequency || lastLacuranity != lacunarity || lastPersistance != persistance || lastLayers != layers || lastDimension != dimension)
+    {
+        // A refine of the old options is useless now
+        finishRefine(true);
+        if (lastDimension != dimension)
+            importedPos.clear();
+        int wanted = preview && dimension > PREVIEW_MIN_DIMENSION && !isImported() ? PREVIEW_STEP : 1;
+        if (wanted != step)
+        {
+            // Every option is applied by the rebuild at the new step
+            lastFreq = frequency;
+            lastLacuranity = lacunarity;
+            lastPersistance = persistance;
+            lastLayers = layers;
+            lastDimension = dimension;
+            setStep(wanted);
+            changed = true;
+        }
+    }
     if (lastFreq != frequency)
     {
         setFrequency(frequency);
-        terrainMesh.setUpMesh();
+        terrainMesh.updateStreams();
         lastFreq = frequency;
+        changed = true;
     }
     if (lastLacuranity != lacunarity)
     {
         setLacunarity(lacunarity);
-        terrainMesh.setUpMesh();
+        terrainMesh.updateStreams();
         lastLacuranity = lacunarity;
+        changed = true;
     }
     if (lastPersistance != persistance)
     {
         setPersistance(persistance);
-        terrainMesh.setUpMesh();
+        terrainMesh.updateStreams();
         lastPersistance = persistance;
+        changed = true;
     }
     if (lastLayers != layers)
     {
         setLayers(layers);
-        terrainMesh.setUpMesh();
+        terrainMesh.updateStreams();
         lastLayers = layers;
+        changed = true;
     }
     if (lastDimension != dimension)
     {
-        setDimension(dimension, dimension);
+        // The imported map has its own size, a new one goes back to the noise
+        importedPos.clear();
+        setDimension(meshSide(), meshSide());
         terrainMesh.setUpMesh();
         lastDimension = dimension;
+        changed = true;
     }
+    // Distance and map height are shader uniforms, nothing is uploaded
     if (lastDistance != distance)
     {
         setDistance(distance);
-        terrainMesh.setUpMesh();
         lastDistance = distance;
+        changed = true;
     }
     if (lastMapHeight != mapHeight)
     {
         setMapHeight(mapHeight);
-        terrainMesh.setUpMesh();
         lastMapHeight = mapHeight;
+        changed = true;
+    }
+    // Released, the preview stays on screen until the full resolution is ready
+    if (!preview && step > 1 && !refineTask.valid())
+    {
+        startRefine();
+        changed |= step == 1;
+    }
+    return changed;
+}
+
+void Terrain::setStep(int _step)
+{
+    step = _step;
+    setDimension(meshSide(), meshSide());
+    terrainMesh.setUpMesh();
+}
+
+void Terrain::startRefine()
+{
+    // Options that were refined before are still in the cache, under the full size
+    // and not the size of the preview on screen
+    if (resultCache.contains(getResultKey(1, dimension, dimension)))
+    {
+        setStep(1);
+        return;
     }
+    int side = dimension + 1;
+    pool.fit(refinedPos, side * side, MEM_HEIGHTMAP);
+    // The task gets copies, the options can change on the main thread meanwhile
+    PerlinNoise noise = perlin;
+    NoiseOptions options = getNoiseOptions();
+    int workers = threads;
+    refineCancel = false;
+    refineTask = async(launch::async, [this, noise, options, side, workers]()
+                       {
+                           TraceScope trace("Refine", {{"dimension", side - 1}});
+                           float low, high;
+                           generateNoise(noise, options, 1, side, side, workers, refinedPos.data(), low, high, refineCancel); });
+}
+
+void Terrain::finishRefine(bool cancel)
+{
+    if (!refineTask.valid())
+        return;
+    refineCancel = cancel;
+    refineTask.get();
+    if (cancel)
+        return;
+    ProfileScope scope("Refine mesh", false, {{"dimension", dimension}});
+    refined = true;
+    setStep(1);
+    refined = false;
 }
 
 void Terrain::setWidth(int _width)
@@ -112,8 +245,7 @@ void Terrain::setWidth(int _width)
 void Terrain::setHeight(int _height)
 {
     height = _height;
-    generateHeightMap();
-    generateNormals();
+    resetOptions();
 }
 
 void Terrain::setDimension(int _width, int _height)
@@ -126,89 +258,229 @@ void Terrain::setDimension(int _width, int _height)
 void Terrain::setFrequency(float _frequency)
 {
     frequency = _frequency;
-    generateTerrain(terrainPos);
-    generateHeightMap();
-    generateNormals();
+    regenerate();
 }
 void Terrain::setLacunarity(float _lacunarity)
 {
     lacunarity = _lacunarity;
-    generateTerrain(terrainPos);
-    generateHeightMap();
-    generateNormals();
+    regenerate();
 }
 
 void Terrain::setPersistance(float _persistance)
 {
     persistance = _persistance;
-    generateTerrain(terrainPos);
-    generateHeightMap();
-    generateNormals();
+    regenerate();
 }
 
 void Terrain::setLayers(int _layers)
 {
     layers = _layers;
+    regenerate();
+}
+
+void Terrain::regenerate()
+{
+    noiseVersion++;
+    // An imported map isn't described by the options, it's never cached
+    bool cacheable = importedPos.empty() && resultCache.getBudget() > 0;
+    uint64_t key = cacheable ? getResultKey(step, width, height) : 0;
+    shared_ptr<const TerrainResult> cached;
+    if (cacheable && resultCache.get(key, cached))
+    {
+        ProfileScope scope("Cache restore", false, {{"width", width}, {"height", height}});
+        copy(cached->heightmap.begin(), cached->heightmap.end(), terrainPos.begin());
+        vector<GLfloat> &heights = terrainMesh.streamData(heightStream);
+        vector<GLfloat> &normals = terrainMesh.streamData(normalStream);
+        copy(cached->heights.begin(), cached->heights.end(), heights.begin());
+        copy(cached->normals.begin(), cached->normals.end(), normals.begin());
+        copiedBytes += cached->getBytes();
+        terrainMesh.markDirty(heightStream);
+        terrainMesh.markDirty(normalStream);
+        minNoise = cached->minNoise;
+        maxNoise = cached->maxNoise;
+        updateBounds();
+        return;
+    }
     generateTerrain(terrainPos);
     generateHeightMap();
     generateNormals();
+    if (!cacheable)
+        return;
+
+    auto result = make_shared<TerrainResult>();
+    result->heightmap = terrainPos;
+    result->heights = terrainMesh.streamData(heightStream);
+    result->normals = terrainMesh.streamData(normalStream);
+    result->minNoise = minNoise;
+    result->maxNoise = maxNoise;
+    copiedBytes += result->getBytes();
+    MemoryTracker::allocate(MEM_RESULT_CACHE, result->getBytes());
+    resultCache.put(key, result, result->getBytes());
+}
+
+uint64_t Terrain::getResultKey(int keyStep, int keyWidth, int keyHeight)
+{
+    // FNV-1a of everything the noise, the heights and the normals depend on
+    uint64_t key = 1469598103934665603ULL;
+    auto add = [&key](const void *data, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; i++)
+        {
+            key ^= ((const unsigned char *)data)[i];
+            key *= 1099511628211ULL;
+        }
+    };
+    unsigned int seed = perlin.getSeed();
+    add(&seed, sizeof(seed));
+    add(&keyWidth, sizeof(keyWidth));
+    add(&keyHeight, sizeof(keyHeight));
+    add(&dimension, sizeof(dimension));
+    add(&layers, sizeof(layers));
+    add(&frequency, sizeof(frequency));
+    add(&persistance, sizeof(persistance));
+    add(&lacunarity, sizeof(lacunarity));
+    add(&keyStep, sizeof(keyStep));
+    return key;
+}
+
+NoiseOptions Terrain::getNoiseOptions()
+{
+    NoiseOptions options;
+    options.layers = layers;
+    options.frequency = frequency;
+    options.persistance = persistance;
+    options.lacunarity = lacunarity;
+    options.dimension = dimension;
+    return options;
 }
 
 void Terrain::setMapHeight(float _mapHeight)
 {
+    // Applied in the vertex shader, the normals are scaled there too
     mapHeight = _mapHeight;
-    generateHeightMap();
-    generateNormals();
+    updateBounds();
 }
 void Terrain::resetTerrain()
 {
-    vector<vector<GLfloat>> positions(height + 1, vector<GLfloat>(width + 1));
-    terrainPos = positions;
-    generateTerrain(terrainPos);
+    pool.fit(terrainPos, (height + 1) * (width + 1), MEM_HEIGHTMAP);
+}
+
+void Terrain::resetColorBands()
+{
+    colorBands = {
+        {terrainColors.water, 0.2f},
+        {terrainColors.sandy, 0.23f},
+        {terrainColors.beach, 0.26f},
+        {terrainColors.terrain, 0.5f},
+        {terrainColors.jungle, 0.6f},
+        {terrainColors.mountain, 0.7f},
+        {terrainColors.snow, 1.0f},
+    };
+    updateColorBands();
+}
+
+void Terrain::updateColorBands()
+{
+    ColorBandsBlock block = {};
+    block.numBands = min((int)colorBands.size(), MAX_COLOR_BANDS);
+    for (int i = 0; i < block.numBands; i++)
+        block.bands[i] = colorBands[i];
+    colorBandsUBO.update(&block, sizeof(block));
 }
 
 void Terrain::resetSeed()
 {
-    setUp();
+    setSeed(random_device{}());
+}
+
+void Terrain::setSeed(unsigned int _seed)
+{
+    finishRefine(true);
+    importedPos.clear();
+    perlin = PerlinNoise(_seed);
     resetOptions();
     terrainMesh.setUpMesh();
 }
 
+Heightmap Terrain::getHeightmap()
+{
+    finishRefine(false);
+    Heightmap map;
+    map.width = width + 1;
+    map.height = height + 1;
+    map.samples = terrainPos;
+    return map;
+}
+
+void Terrain::loadHeightmap(Heightmap &&map)
+{
+    finishRefine(true);
+    step = 1;
+    importedPos = move(map.samples);
+    dimension = lastDimension = max(map.width, map.height) - 1;
+    setDimension(map.width - 1, map.height - 1);
+    terrainMesh.setUpMesh();
+}
+
+void Terrain::setNoise(const vector<GLfloat> &noise)
+{
+    if (noise.size() != terrainPos.size())
+    {
+        cout << "ERROR::TERRAIN::NOISE_SIZE: " << noise.size() << " samples for " << terrainPos.size() << "\n";
+        return;
+    }
+    ProfileScope scope("Set noise", false, {{"width", width}, {"height", height}});
+    copy(noise.begin(), noise.end(), terrainPos.begin());
+    copiedBytes += noise.size() * sizeof(GLfloat);
+    minNoise = *min_element(terrainPos.begin(), terrainPos.end());
+    maxNoise = *max_element(terrainPos.begin(), terrainPos.end());
+    updateBounds();
+    generateHeightMap();
+    generateNormals();
+    terrainMesh.updateStreams();
+}
+
 void Terrain::resetOptions()
 {
     // Vector to track the common vertices at one point Ex: (1,2)->{5,6,9,10}
-    vector<vector<vector<GLuint>>> vert(height + 1, vector<vector<GLuint>>(width + 1));
-    commonVert = vert;
+    // Every point has MAX_COMMON_VERT slots and commonCount says how many are used
+    int numPoints = (height + 1) * (width + 1);
+    pool.fit(commonVert, MAX_COMMON_VERT * numPoints, MEM_ADJACENCY);
+    pool.fit(commonCount, numPoints, MEM_ADJACENCY);
+    fill(commonCount.begin(), commonCount.end(), 0);
     resetTerrain();
+    // The grid and the indices only depend on the size, the rest can come from the cache
     generateVertices();
     generateIndices();
-    generateHeightMap();
-    generateNormals();
+    regenerate();
 }
 
 void Terrain::setDistance(float _dist)
 {
-    for (int posz = 0; posz <= height; posz++)
-    {
-        for (int posx = 0; posx <= width; posx++)
-        {
-            for (auto &v : commonVert[posz][posx])
-            {
-                terrainMesh.vertices[v].position.x = (distance * posx);
-                terrainMesh.vertices[v].position.z = (distance * posz);
-            }
-        }
-    }
-    generateNormals();
+    // Applied in the vertex shader, the normals are scaled there too
+    distance = _dist;
+    updateBounds();
 }
 
 void Terrain::generateVertices()
 {
+    ProfileScope scope("Vertices", false, {{"width", width}, {"height", height}});
     int tamN = height + 1, tamM = width + 1;
 
     int numVert = (2 * (tamN - 1)) * (2 * (tamM - 1));
 
-    vector<Vertex> vertices(numVert);
+    // The X and Z of each vertex in grid units, they only change with the dimension
+    vector<GLfloat> &grid = terrainMesh.streamData(gridStream);
+    // Every vertex is written later, no need to clear them
+    pool.fit(grid, 2 * numVert, MEM_VERTEX);
+    pool.fit(terrainMesh.streamData(heightStream), numVert, MEM_VERTEX);
+    pool.fit(terrainMesh.streamData(normalStream), 3 * numVert, MEM_VERTEX);
+    // Copies the grid position of a vertex into another one
+    auto copyVertex = [&grid](int dst, int src)
+    {
+        grid[2 * dst] = grid[2 * src];
+        grid[2 * dst + 1] = grid[2 * src + 1];
+    };
 
     // Generate Vertex
     for (int posz = 0, idx = 0; posz <= tamN - 1; posz++)
@@ -217,30 +489,30 @@ void Terrain::generateVertices()
         int lastM = 2 * (tamM - 1);
         for (int posx = 0; posx <= tamM - 1; posx++)
         {
-            vertices[idx].normal = glm::vec3(0.0f, 1.0f, 0.0f);
-            vertices[idx].color = glm::vec3(0.0f, 0.0f, 1.0f);
-            vertices[idx].position = glm::vec3(distance * posx, 1.0f, distance * posz);
+            // Position in samples of the full grid, the last preview cell can be shorter
+            grid[2 * idx] = min(posx * step, max(width, dimension));
+            grid[2 * idx + 1] = min(posz * step, max(height, dimension));
 
             // The corners
             if ((posz == 0 && posx == 0) || (posz == 0 && posx == tamM - 1) || (posz == tamN - 1 && posx == 0) || (posx == tamM - 1 && posz == tamN - 1))
             {
-                commonVert[posz][posx].push_back(idx);
+                addCommonVert(posz, posx, idx);
                 idx++;
             }
             // (0, X) ^ (tamN, X)
             else if ((posz == 0 && posx < tamM - 1) || (posz == tamN - 1 && posx < tamM - 1))
             {
-                vertices[idx + 1] = vertices[idx];
-                commonVert[posz][posx].push_back(idx);
-                commonVert[posz][posx].push_back(idx + 1);
+                copyVertex(idx + 1, idx);
+                addCommonVert(posz, posx, idx);
+                addCommonVert(posz, posx, idx + 1);
                 idx += 2;
             }
             // (X, 0) ^ (X, tamM)
             else if ((posx == 0 && posz < tamN - 1) || (posx == tamN - 1 && posz < tamN - 1))
             {
-                vertices[idx + lastN] = vertices[idx];
-                commonVert[posz][posx].push_back(idx);
-                commonVert[posz][posx].push_back(idx + lastN);
+                copyVertex(idx + lastN, idx);
+                addCommonVert(posz, posx, idx);
+                addCommonVert(posz, posx, idx + lastN);
 
                 // Si estas al final de la columna salta en lastN indices sino ve al siguiente
                 idx += (posx == tamN - 1) ? lastN + 1 : 1;
@@ -248,22 +520,27 @@ void Terrain::generateVertices()
             // The middle points (X,X)
             else if (posx > 0 && posx < tamM - 1 && posz > 0 && posz < tamN - 1)
             {
-                vertices[idx + 1] = vertices[idx + lastN] = vertices[idx + lastN + 1] = vertices[idx];
-                commonVert[posz][posx].push_back(idx);
-                commonVert[posz][posx].push_back(idx + 1);
-                commonVert[posz][posx].push_back(idx + lastN);
-                commonVert[posz][posx].push_back(idx + lastN + 1);
+                copyVertex(idx + 1, idx);
+                copyVertex(idx + lastN, idx);
+                copyVertex(idx + lastN + 1, idx);
+                addCommonVert(posz, posx, idx);
+                addCommonVert(posz, posx, idx + 1);
+                addCommonVert(posz, posx, idx + lastN);
+                addCommonVert(posz, posx, idx + lastN + 1);
                 idx += 2;
             }
         }
     }
-    terrainMesh.setVertices(vertices);
+    terrainMesh.markDirty(gridStream);
 }
 void Terrain::generateIndices()
 {
+    ProfileScope scope("Indices", false, {{"width", width}, {"height", height}});
     int tamN = height + 1, tamM = width + 1;
     int numInd = height * width * 6;
-    vector<GLuint> ind(numInd);
+    // Written straight into the mesh
+    vector<GLuint> &ind = terrainMesh.indices;
+    pool.fit(ind, numInd, MEM_INDEX);
     for (int row = 0, idx = 0; row < tamN - 1; row++)
     {
         int lastN = 2 * (tamN - 1);
@@ -280,24 +557,34 @@ void Terrain::generateIndices()
             ind[idx++] = val + lastN + 1;
         }
     }
-    terrainMesh.setIndices(ind);
 }
 
 void Terrain::generateNormals()
 {
+    ProfileScope scope("Normals", false, {{"width", width}, {"height", height}});
+    // The normals are computed on the unscaled grid (distance = 1, height = noise)
+    // the vertex shader transforms them with the current distance and map height
+    vector<GLfloat> &grid = terrainMesh.streamData(gridStream);
+    vector<GLfloat> &heights = terrainMesh.streamData(heightStream);
+    glm::vec3 *normals = (glm::vec3 *)terrainMesh.streamData(normalStream).data();
+    auto position = [&grid, &heights](int v)
+    {
+        return glm::vec3(grid[2 * v], heights[v], grid[2 * v + 1]);
+    };
+
     int tamN = height + 1, tamM = width + 1;
     // Assing the correct Normal Vector to each Face (Flat Shading)
-    for (int row = 0, idx = 0; row < tamN - 1; row++)
+    for (int row = 0; row < tamN - 1; row++)
     {
         int lastN = 2 * (tamN - 1);
         for (int col = 0, val = 2 * lastN * (row); col < tamM - 1; col++, val += 2)
         {
 
-            glm::vec3 normal = getNormalVector(terrainMesh.vertices[val].position, terrainMesh.vertices[val + 1].position, terrainMesh.vertices[val + lastN].position);
-            terrainMesh.vertices[val].normal = normal;
-            terrainMesh.vertices[val + 1].normal = normal;
-            terrainMesh.vertices[val + lastN].normal = normal;
-            terrainMesh.vertices[val + lastN + 1].normal = normal;
+            glm::vec3 normal = getNormalVector(position(val), position(val + 1), position(val + lastN));
+            normals[val] = normal;
+            normals[val + 1] = normal;
+            normals[val + lastN] = normal;
+            normals[val + lastN + 1] = normal;
         }
     }
     // for smooth shading
@@ -305,63 +592,42 @@ void Terrain::generateNormals()
     {
         for (int posx = 0; posx <= width; posx++)
         {
+            int point = gridIndex(posz, posx);
+            GLuint *verts = &commonVert[MAX_COMMON_VERT * point];
             glm::vec3 normal = glm::vec3(0.0f, 0.0f, 0.0f);
-            for (auto &v : commonVert[posz][posx])
+            for (int k = 0; k < commonCount[point]; k++)
             {
-                normal += terrainMesh.vertices[v].normal;
+                normal += normals[verts[k]];
             }
             normal = glm::normalize(normal);
-            for (auto &v : commonVert[posz][posx])
+            for (int k = 0; k < commonCount[point]; k++)
             {
-                terrainMesh.vertices[v].normal = normal;
+                normals[verts[k]] = normal;
             }
         }
     }
+    terrainMesh.markDirty(normalStream);
 }
 
 void Terrain::generateHeightMap()
 {
-
-    // The noise value is used for the color of the vertice
-
-    // Reset the -Y- component for the height map
-    // for (auto &v : terrainMesh.vertices)
-    //     v.position.y = 1.0f;
-
-    // Assing the corresponding height to the Y component of the vertices
-    for (unsigned int posz = 0, idx = 0; posz < terrainPos.size(); posz++)
+    ProfileScope scope("Height map", false, {{"width", width}, {"height", height}});
+    // Only the noise is stored, the vertex shader computes Y = 1 + noise * mapHeight
+    vector<GLfloat> &heights = terrainMesh.streamData(heightStream);
+    for (int posz = 0; posz <= height; posz++)
     {
-        for (unsigned int posx = 0; posx < terrainPos[0].size(); posx++)
+        for (int posx = 0; posx <= width; posx++)
         {
-            float noise = terrainPos[posz][posx];
-            for (auto v : commonVert[posz][posx])
+            int point = gridIndex(posz, posx);
+            GLuint *verts = &commonVert[MAX_COMMON_VERT * point];
+            float noise = terrainPos[point];
+            for (int k = 0; k < commonCount[point]; k++)
             {
-                terrainMesh.vertices[v].position.y = 1.0f + (noise * mapHeight);
-
-                terrainMesh.vertices[v].color = getColor(noise);
+                heights[verts[k]] = noise;
             }
         }
     }
-}
-
-glm::vec3 Terrain::getColor(float noise)
-{
-    glm::vec3 color;
-    if (noise < 0.2f) // Water
-        color = terrainColors.water;
-    else if (noise < 0.23f) // Sand
-        color = terrainColors.sandy;
-    else if (noise < 0.26f) // Beach
-        color = terrainColors.beach;
-    else if (noise < 0.5f)
-        color = terrainColors.terrain;
-    else if (noise < 0.6f)
-        color = terrainColors.jungle;
-    else if (noise < 0.7f)
-        color = terrainColors.mountain;
-    else // Snow
-        color = terrainColors.snow;
-    return color;
+    terrainMesh.markDirty(heightStream);
 }
 
 glm::vec3 Terrain::getNormalVector(glm::vec3 vert1, glm::vec3 vert2, glm::vec3 vert3)
@@ -372,42 +638,94 @@ glm::vec3 Terrain::getNormalVector(glm::vec3 vert1, glm::vec3 vert2, glm::vec3 v
     return glm::normalize(glm::cross(firstV, secondV));
 }
 
-void Terrain::generateTerrain(vector<vector<GLfloat>> &positions)
+void Terrain::generateTerrain(vector<GLfloat> &positions)
 {
-    float maxNoiseValue = 0, totalAmp = 0;
-    vector<GLfloat> Noises;
-    for (int i = 0; i < positions.size(); i++)
+    ProfileScope scope("Noise", false, {{"width", width}, {"height", height}, {"octaves", layers}, {"frequency", frequency}, {"threads", threads}});
+    if (!importedPos.empty() || refined)
     {
-        for (int j = 0; j < positions[0].size(); j++)
-        {
-            float totalNoise = 0, freq = frequency, amp = 1.0f;
-            totalAmp = 0;
-            for (int k = 0; k < layers; k++)
-            {
-                float waveLenght = dimension / freq;
-                float noise = amp * (perlinNoise(i / waveLenght, j / waveLenght));
-                totalNoise += noise;
-                freq *= lacunarity;
-                amp *= persistance;
-                totalAmp += amp;
-            }
-            totalNoise += 1.0f;
-            totalNoise *= 0.5f;
-            maxNoiseValue = max(maxNoiseValue, totalNoise);
-            positions[i][j] = totalNoise;
-            // Noises.push_back(totalNoise);
-        }
+        // Imported or made by the refine, the noise is skipped
+        const vector<GLfloat> &source = refined ? refinedPos : importedPos;
+        copy(source.begin(), source.end(), positions.begin());
+        copiedBytes += source.size() * sizeof(GLfloat);
+        minNoise = *min_element(positions.begin(), positions.end());
+        maxNoise = *max_element(positions.begin(), positions.end());
+        updateBounds();
+        return;
+    }
+    atomic<bool> keepGoing(false);
+    generateNoise(perlin, getNoiseOptions(), step, height + 1, width + 1, threads, positions.data(), minNoise, maxNoise, keepGoing);
+    updateBounds();
+}
+
+void Terrain::generateNoise(const PerlinNoise &noise, const NoiseOptions &options, int step, int rows, int columns, int threads,
+                            GLfloat *positions, float &minNoise, float &maxNoise, const atomic<bool> &cancel)
+{
+    // Every point only depends on its coordinates, so the rows are split in bands
+    int bands = max(1, min(threads, rows));
+    vector<float> bandMin(bands), bandMax(bands);
+    vector<thread> workers;
+    for (int band = 1; band < bands; band++)
+    {
+        workers.emplace_back([&, band]()
+                             {
+                                 TraceScope trace("Noise rows", {{"band", band}});
+                                 generateRows(noise, options, step, columns, positions, band * rows / bands, (band + 1) * rows / bands, bandMin[band], bandMax[band], cancel); });
     }
-    // Normalizing to get values between (0.0, 1.0)
-    // for (float &n : Noises)
-    //     n /= totalAmp;
+    generateRows(noise, options, step, columns, positions, 0, rows / bands, bandMin[0], bandMax[0], cancel);
+    for (auto &worker : workers)
+        worker.join();
+
+    minNoise = *min_element(bandMin.begin(), bandMin.end());
+    maxNoise = *max_element(bandMax.begin(), bandMax.end());
+}
 
-    for (int i = 0, count = 0; i < positions.size(); i++)
+void Terrain::generateRows(const PerlinNoise &noise, const NoiseOptions &options, int step, int columns, GLfloat *positions,
+                           int firstRow, int lastRow, float &rowsMin, float &rowsMax, const atomic<bool> &cancel)
+{
+    rowsMin = FLT_MAX;
+    rowsMax = -FLT_MAX;
+    for (int i = firstRow; i < lastRow && !cancel; i++)
     {
-        for (int j = 0; j < positions[0].size(); j++)
+        // The preview takes every step-th sample, the last one stays on the edge of the map
+        int row = min(i * step, options.dimension);
+        for (int j = 0; j < columns; j++)
         {
-            // positions[i][j] /= totalAmp;
-            // positions[i][j] = pow(positions[i][j], 1.2f);
+            float totalNoise = noise.fractal(options, row, min(j * step, options.dimension));
+            rowsMin = min(rowsMin, totalNoise);
+            rowsMax = max(rowsMax, totalNoise);
+            positions[(size_t)i * columns + j] = totalNoise;
         }
     }
 }
+
+void Terrain::updateBounds()
+{
+    // The heightmap range gives the box without looking at the vertices
+    glm::vec3 boxMin(0.0f, 1.0f + minNoise * mapHeight, 0.0f);
+    glm::vec3 boxMax(min(width * step, dimension) * distance, 1.0f + maxNoise * mapHeight, min(height * step, dimension) * distance);
+    terrainMesh.setBounds(BoundingBox(boxMin, boxMax));
+}
+
+float Terrain::getHeightAt(float x, float z)
+{
+    if (distance <= 0.0f)
+        return 1.0f;
+    // In mesh cells, a preview has one every step samples
+    float gridX = glm::clamp(x / (distance * step), 0.0f, (float)width);
+    float gridZ = glm::clamp(z / (distance * step), 0.0f, (float)height);
+    int posx = min((int)gridX, width - 1);
+    int posz = min((int)gridZ, height - 1);
+    float fx = gridX - posx, fz = gridZ - posz;
+
+    float h00 = terrainPos[gridIndex(posz, posx)];
+    float h10 = terrainPos[gridIndex(posz, posx + 1)];
+    float h01 = terrainPos[gridIndex(posz + 1, posx)];
+    float h11 = terrainPos[gridIndex(posz + 1, posx + 1)];
+    // Same split as generateIndices: (x, z), (x + 1, z), (x, z + 1) is the first triangle
+    float noise;
+    if (fx + fz <= 1.0f)
+        noise = h00 + fx * (h10 - h00) + fz * (h01 - h00);
+    else
+        noise = h11 + (1.0f - fx) * (h01 - h11) + (1.0f - fz) * (h10 - h11);
+    return 1.0f + noise * mapHeight;
+}
@@ -39,6 +39,9 @@ Texture::Texture(const char *image, const char *texType, GLuint slot, GLenum for
 	glTexImage2D(GL_TEXTURE_2D, 0, (numColCh > 3 ? GL_RGBA : GL_RGB), widthImg, heightImg, 0, (numColCh > 3 ? GL_RGBA : GL_RGB), pixelType, bytes);
 	// Generates MipMaps
 	glGenerateMipmap(GL_TEXTURE_2D);
+	// The mipmap chain adds about a third to the base level
+	size = (size_t)widthImg * heightImg * (numColCh > 3 ? 4 : 3) * 4 / 3;
+	MemoryTracker::allocate(MEM_TEXTURES, size);
 
 	// Deletes the image data as it is already in the OpenGL Texture object
 	stbi_image_free(bytes);
@@ -49,12 +52,10 @@ Texture::Texture(const char *image, const char *texType, GLuint slot, GLenum for
 
 void Texture::texUnit(Shader &shader, const char *uniform, GLuint unit)
 {
-	// Gets the location of the uniform
-	GLuint texUni = glGetUniformLocation(shader.ID, uniform);
 	// Shader needs to be activated before changing the value of a uniform
 	shader.Activate();
-	// Sets the value of the uniform
-	glUniform1i(texUni, unit);
+	// Sets the value of the uniform (location from the shader cache)
+	shader.setInt(uniform, unit);
 }
 
 void Texture::Bind()
@@ -71,4 +72,6 @@ void Texture::Unbind()
 void Texture::Delete()
 {
 	glDeleteTextures(1, &ID);
+	MemoryTracker::release(MEM_TEXTURES, size);
+	size = 0;
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "../include/TileGenerator.h"
+#include "../include/Heightmap.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+uint64_t GenerationOptions::hash() const
+{
+    // FNV-1a of the fields, in a fixed order
+    uint64_t value = 1469598103934665603ull;
+    auto add = [&value](const void *data, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; i++)
+        {
+            value ^= ((const unsigned char *)data)[i];
+            value *= 1099511628211ull;
+        }
+    };
+    add(&seed, sizeof(seed));
+    add(&size, sizeof(size));
+    add(&layers, sizeof(layers));
+    add(&frequency, sizeof(frequency));
+    add(&persistance, sizeof(persistance));
+    add(&lacunarity, sizeof(lacunarity));
+    add(&distance, sizeof(distance));
+    add(&mapHeight, sizeof(mapHeight));
+    return value;
+}
+
+TileGenerator::TileGenerator(const GenerationOptions &options) : options(options), perlin(options.seed)
+{
+    noise.layers = options.layers;
+    noise.frequency = options.frequency;
+    noise.persistance = options.persistance;
+    noise.lacunarity = options.lacunarity;
+    noise.dimension = max(1, options.size - 1);
+}
+
+void TileGenerator::generateRegion(int x, int y, int w, int h, float *out) const
+{
+    int last = options.size - 1;
+    for (int row = 0; row < h; row++)
+    {
+        int my = max(0, min(y + row, last));
+        for (int col = 0; col < w; col++)
+            out[(size_t)row * w + col] = perlin.fractal(noise, my, max(0, min(x + col, last)));
+    }
+}
+
+void TileGenerator::generateTile(int tx, int ty, int tileSize, float *heights) const
+{
+    generateRegion(tx * tileSize, ty * tileSize, tileSize, tileSize, heights);
+}
+
+void TileGenerator::generateNormals(int tx, int ty, int tileSize, uint32_t *normals, vector<float> &scratch) const
+{
+    // One sample of apron on every side, the same central differences as MeshExporter
+    int A = tileSize + 2;
+    scratch.resize((size_t)A * A);
+    generateRegion(tx * tileSize - 1, ty * tileSize - 1, A, A, scratch.data());
+    for (int y = 0; y < tileSize; y++)
+    {
+        for (int x = 0; x < tileSize; x++)
+        {
+            auto at = [&](int dx, int dy)
+            { return scratch[(y + 1 + dy) * A + x + 1 + dx] * options.mapHeight; };
+            float nx = -(at(1, 0) - at(-1, 0)) / (2.0f * options.distance);
+            float nz = -(at(0, 1) - at(0, -1)) / (2.0f * options.distance);
+            float length = sqrt(nx * nx + 1.0f + nz * nz);
+            normals[y * tileSize + x] = packNormal(nx / length, 1.0f / length, nz / length);
+        }
+    }
+}
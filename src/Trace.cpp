@@ -0,0 +1,145 @@
+#include "../include/Trace.h"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+atomic<bool> Trace::enabled(false);
+string Trace::path;
+vector<Trace::Event> Trace::events;
+size_t Trace::dropped = 0;
+mutex Trace::eventsMutex;
+chrono::steady_clock::time_point Trace::startTime;
+
+void Trace::start(const string &_path)
+{
+    lock_guard<mutex> lock(eventsMutex);
+    path = _path;
+    events.clear();
+    dropped = 0;
+    startTime = chrono::steady_clock::now();
+    enabled = true;
+}
+
+void Trace::stop()
+{
+    lock_guard<mutex> lock(eventsMutex);
+    if (!enabled)
+        return;
+    enabled = false;
+
+    ofstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::TRACE::CANNOT_WRITE: " << path << "\n";
+        return;
+    }
+    file << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const Event &event = events[i];
+        file << "{\"name\":";
+        writeString(file, event.name);
+        file << ",\"ph\":\"" << event.phase << "\",\"ts\":" << fixed << setprecision(3) << event.timestamp << ",\"pid\":1,\"tid\":" << event.thread;
+        if (!event.label.empty())
+        {
+            file << ",\"args\":{\"name\":";
+            writeString(file, event.label);
+            file << "}";
+        }
+        else if (!event.args.empty())
+        {
+            file << ",\"args\":{";
+            for (size_t j = 0; j < event.args.size(); j++)
+            {
+                file << (j ? "," : "");
+                writeString(file, event.args[j].first);
+                file << ":" << defaultfloat << setprecision(6) << event.args[j].second;
+            }
+            file << "}";
+        }
+        file << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    file << "],\"displayTimeUnit\":\"ms\"}\n";
+    cout << "Trace: " << events.size() << " events written to " << path;
+    if (dropped)
+        cout << " (" << dropped << " dropped)";
+    cout << "\n";
+    events.clear();
+    events.shrink_to_fit();
+}
+
+void Trace::begin(const char *name, initializer_list<TraceArg> args)
+{
+    if (!enabled)
+        return;
+    threadDepth()++;
+    push({name, 'B', 0.0, threadId(), args});
+}
+
+void Trace::end()
+{
+    // An end without its begin (the capture started inside the block) is skipped
+    int &depth = threadDepth();
+    if (depth == 0)
+        return;
+    depth--;
+    if (enabled)
+        push({"", 'E', 0.0, threadId(), {}});
+}
+
+void Trace::setThreadName(const string &name)
+{
+    if (!enabled)
+        return;
+    push({"thread_name", 'M', 0.0, threadId(), {}, name});
+}
+
+size_t Trace::getEventCount()
+{
+    lock_guard<mutex> lock(eventsMutex);
+    return events.size();
+}
+
+int Trace::threadId()
+{
+    static atomic<int> nextThread(1);
+    thread_local int id = nextThread++;
+    return id;
+}
+
+int &Trace::threadDepth()
+{
+    thread_local int depth = 0;
+    return depth;
+}
+
+void Trace::push(Event &&event)
+{
+    lock_guard<mutex> lock(eventsMutex);
+    if (!enabled)
+        return;
+    if (events.size() >= TRACE_MAX_EVENTS)
+    {
+        dropped++;
+        return;
+    }
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - startTime;
+    event.timestamp = elapsed.count();
+    events.push_back(move(event));
+}
+
+void Trace::writeString(ostream &out, const string &text)
+{
+    out << '"';
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec << setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+}
@@ -0,0 +1,39 @@
+#include "../include/UBO.h"
+
+UBO::UBO(GLsizeiptr size, GLuint binding) : binding(binding), size(size)
+{
+    glGenBuffers(1, &ID);
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+
+    // Allocate the storage, the content is written later with update()
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    MemoryTracker::allocate(MEM_GPU_BUFFERS, size);
+
+    // Link the whole buffer to its binding point
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UBO::update(const void *data, GLsizeiptr size, GLintptr offset)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UBO::Bind()
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+}
+
+void UBO::Unbind()
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UBO::Delete()
+{
+    glDeleteBuffers(1, &ID);
+    MemoryTracker::release(MEM_GPU_BUFFERS, size);
+    size = 0;
+}
@@ -6,7 +6,34 @@ VBO::VBO(vector<Vertex> &vertices)
     glBindBuffer(GL_ARRAY_BUFFER, ID);
 
     // Introduce the vertices into the VBO
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    size = vertices.size() * sizeof(Vertex);
+    glBufferData(GL_ARRAY_BUFFER, size, vertices.data(), GL_STATIC_DRAW);
+    MemoryTracker::allocate(MEM_GPU_BUFFERS, size);
+}
+
+VBO::VBO()
+{
+    glGenBuffers(1, &ID);
+    MemoryTracker::allocate(MEM_GPU_BUFFERS, 0);
+}
+
+void VBO::update(vector<GLfloat> &data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, ID);
+    // Sliders re-upload the streams many times per second
+    GLsizeiptr newSize = data.size() * sizeof(GLfloat);
+    glBufferData(GL_ARRAY_BUFFER, newSize, data.data(), GL_DYNAMIC_DRAW);
+    MemoryTracker::resize(MEM_GPU_BUFFERS, size, newSize);
+    size = newSize;
+}
+
+void VBO::update(vector<Vertex> &vertices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, ID);
+    GLsizeiptr newSize = vertices.size() * sizeof(Vertex);
+    glBufferData(GL_ARRAY_BUFFER, newSize, vertices.data(), GL_STATIC_DRAW);
+    MemoryTracker::resize(MEM_GPU_BUFFERS, size, newSize);
+    size = newSize;
 }
 
 void VBO::Bind()
@@ -22,4 +49,6 @@ void VBO::Unbind()
 void VBO::Delete()
 {
     glDeleteBuffers(1, &ID);
+    MemoryTracker::release(MEM_GPU_BUFFERS, size);
+    size = 0;
 }
\ No newline at end of file
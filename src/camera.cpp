@@ -109,12 +109,14 @@ void Camera::resetCameraPosition()
     updateMatrix();
 }
 
-void Camera::updateMatrix()
+bool Camera::updateMatrix()
 {
+    glm::mat4 lastMatrix = cameraMatrix;
     glm::mat4 view = this->lookAt(cameraPos, cameraPos + cameraFront, WORLD_UP);
     // glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, WORLD_UP);
     glm::mat4 projection = glm::perspective(glm::radians(fov), (float)width / height, nearPlane, farPlane);
     cameraMatrix = projection * view;
+    return cameraMatrix != lastMatrix;
 }
 
 void Camera::updateViewport(int width, int height)
@@ -129,6 +131,21 @@ void Camera::getMatrix(Shader &shader, const char *uniform)
     shader.setMat4(uniform, cameraMatrix);
 }
 
+void Camera::getMatrix(const Uniform<glm::mat4> &uniform)
+{
+    // Exports camera matrix to the active shader
+    uniform.set(cameraMatrix);
+}
+
+void Camera::getMatrix(UBO &cameraUBO)
+{
+    CameraBlock block;
+    block.camMatrix = cameraMatrix;
+    block.camPos = cameraPos;
+    block.pad = 0.0f;
+    cameraUBO.update(&block, sizeof(block));
+}
+
 void Camera::processInput(GLFWwindow *window, float deltaTime)
 {
     rotationMovement = false;
@@ -1,32 +1,18 @@
 #include "../include/perlin.h"
 
-vector<int> PT;
-
-void random(vector<int> &V)
-{
-    srand(time(0));
-    vector<int> tab = V;
-    for (size_t i = 0; i < V.size(); i++)
-    {
-        int randPos = rand() % tab.size();
-        V[i] = tab[randPos];
-        tab.erase(tab.begin() + randPos);
-    }
-}
-void fillPermutation(vector<int> &table)
+PerlinNoise::PerlinNoise(unsigned int seed) : seed(seed)
 {
     for (int i = 0; i < 256; i++)
-        table.push_back(i);
+        PT[i] = i;
 
-    random(table);
+    // Fisher-Yates with the raw generator output, the std distributions
+    // differ between standard libraries
+    mt19937 generator(seed);
+    for (int i = 255; i > 0; i--)
+        swap(PT[i], PT[generator() % (i + 1)]);
 
     for (int i = 0; i < 256; i++)
-        table.push_back(table[i]);
-}
-
-void setUp()
-{
-    fillPermutation(PT);
+        PT[256 + i] = PT[i];
 }
 
 Vector2D getGradient(int value)
@@ -61,7 +47,20 @@ float fade(float t)
     return ((6 * t - 15) * t + 10) * t * t * t;
 }
 
-float perlinNoise(float x, float y)
+float PerlinNoise::fractal(const NoiseOptions &options, int row, int col) const
+{
+    float total = 0, freq = options.frequency, amp = 1.0f;
+    for (int k = 0; k < options.layers; k++)
+    {
+        float waveLenght = options.dimension / freq;
+        total += amp * noise(row / waveLenght, col / waveLenght);
+        freq *= options.lacunarity;
+        amp *= options.persistance;
+    }
+    return (total + 1.0f) * 0.5f;
+}
+
+float PerlinNoise::noise(float x, float y) const
 {
     // cout << x << " " << y << '\n';
     int X = floor(x);
@@ -1,4 +1,6 @@
 #include "../include/shaderClass.h"
+#include "../include/ShaderCache.h"
+#include <chrono>
 
 // Reads a text file and outputs a string with everything in the text file
 string get_file_contents(const char *filename)
@@ -24,6 +26,70 @@ Shader::Shader(const char *vertexFile, const char *fragmentFile)
     string vertexCode = get_file_contents(vertexFile);
     string fragmentCode = get_file_contents(fragmentFile);
 
+    // Cache entry named after both files Ex: default.vert_default.frag
+    string cacheName = string(vertexFile).substr(string(vertexFile).find_last_of("/\\") + 1) + "_" +
+                       string(fragmentFile).substr(string(fragmentFile).find_last_of("/\\") + 1);
+    build(vertexCode, fragmentCode, cacheName);
+}
+
+// Inserts the defines after the #version line of the source
+static string insertDefines(const string &code, const string &defines)
+{
+    size_t versionEnd = code.find('\n', code.find("#version"));
+    if (versionEnd == string::npos)
+        return defines + code;
+    return code.substr(0, versionEnd + 1) + defines + code.substr(versionEnd + 1);
+}
+
+Shader::Shader(const char *vertexFile, const char *fragmentFile, const ShaderFeatures &features)
+{
+    string defines = features.defines();
+    string vertexCode = insertDefines(get_file_contents(vertexFile), defines);
+    string fragmentCode = insertDefines(get_file_contents(fragmentFile), defines);
+
+    string cacheName = string(vertexFile).substr(string(vertexFile).find_last_of("/\\") + 1) + "_" +
+                       string(fragmentFile).substr(string(fragmentFile).find_last_of("/\\") + 1) + "_" + features.name();
+    build(vertexCode, fragmentCode, cacheName);
+}
+
+string ShaderFeatures::defines() const
+{
+    string result = "#define NUM_POINT_LIGHTS " + to_string(pointLights) + "\n";
+    if (spotLight)
+        result += "#define USE_SPOT_LIGHT\n";
+    if (textures)
+        result += "#define USE_TEXTURES\n";
+    if (terrainColors)
+        result += "#define TERRAIN_COLORS\n";
+    return result;
+}
+
+string ShaderFeatures::name() const
+{
+    return "p" + to_string(pointLights) + "_s" + to_string(spotLight) + "_t" + to_string(textures) + "_c" + to_string(terrainColors);
+}
+
+void Shader::build(const string &vertexCode, const string &fragmentCode, const string &cacheName)
+{
+    auto start = chrono::steady_clock::now();
+    auto elapsedMs = [&start]()
+    {
+        return chrono::duration<float, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    // Try the linked program of a previous run before compiling anything
+    ID = glCreateProgram();
+    uint64_t key = ShaderCache::getKey(vertexCode, fragmentCode);
+    float compileMs;
+    if (ShaderCache::load(ID, cacheName, key, compileMs))
+    {
+        float loadMs = elapsedMs();
+        cout << "Shader cache hit for " << cacheName << ": " << loadMs << " ms (compiling took "
+             << compileMs << " ms, saved " << compileMs - loadMs << " ms)\n";
+        setUpProgram();
+        return;
+    }
+
     // Convert the shader source strings into character arrays
     const char *vertexSource = vertexCode.c_str();
     const char *fragmentSource = fragmentCode.c_str();
@@ -46,19 +112,75 @@ Shader::Shader(const char *vertexFile, const char *fragmentFile)
     // Checks if Shader compiled succesfully
     compileErrors(fragmentShader, "FRAGMENT");
 
-    // Create Shader Program Object and get its reference
-    ID = glCreateProgram();
     // Attach the Vertex and Fragment Shaders to the Shader Program
     glAttachShader(ID, vertexShader);
     glAttachShader(ID, fragmentShader);
+    // Keep the binary so it can be stored in the cache
+    ShaderCache::setRetrievable(ID);
     // Wrap-up/Link all the shaders together into the Shader Program
     glLinkProgram(ID);
     // Checks if Shaders linked succesfully
     compileErrors(ID, "PROGRAM");
 
     // Delete the now useless Vertex and Fragment Shader objects
+    glDetachShader(ID, vertexShader);
+    glDetachShader(ID, fragmentShader);
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (linked == GL_TRUE)
+    {
+        compileMs = elapsedMs();
+        cout << "Shader cache miss for " << cacheName << ": compiled in " << compileMs << " ms\n";
+        ShaderCache::save(ID, cacheName, key, compileMs);
+    }
+    setUpProgram();
+}
+
+void Shader::setUpProgram()
+{
+    cacheUniforms();
+    // The shared blocks are linked to every program
+    bindUniformBlock("ColorBands", COLOR_BANDS_BINDING);
+    bindUniformBlock("Camera", CAMERA_BINDING);
+    bindUniformBlock("Lights", LIGHTS_BINDING);
+}
+
+void Shader::cacheUniforms()
+{
+    GLint numUniforms = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &numUniforms);
+    char name[256];
+    for (GLint i = 0; i < numUniforms; i++)
+    {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+        GLint location = glGetUniformLocation(ID, name);
+        // Members of uniform blocks don't have a location
+        if (location == -1)
+            continue;
+
+        string uniformName(name, length);
+        uniformLocations[uniformName] = location;
+        // Arrays are reported as "name[0]", the elements have consecutive locations
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+        {
+            string baseName = uniformName.substr(0, uniformName.size() - 3);
+            uniformLocations[baseName] = location;
+            for (GLint element = 1; element < size; element++)
+                uniformLocations[baseName + "[" + to_string(element) + "]"] = location + element;
+        }
+    }
+}
+
+GLint Shader::getUniformLocation(const std::string &name) const
+{
+    auto it = uniformLocations.find(name);
+    return it == uniformLocations.end() ? -1 : it->second;
 }
 
 // Activates the Shader Program
@@ -73,63 +195,110 @@ void Shader::Delete()
     glDeleteProgram(ID);
 }
 
+// uniform functions by location
+// ------------------------------------------------------------------------
+void setUniform(GLint location, bool value)
+{
+    glUniform1i(location, (int)value);
+}
+void setUniform(GLint location, int value)
+{
+    glUniform1i(location, value);
+}
+void setUniform(GLint location, float value)
+{
+    glUniform1f(location, value);
+}
+void setUniform(GLint location, const glm::vec2 &value)
+{
+    glUniform2fv(location, 1, &value[0]);
+}
+void setUniform(GLint location, const glm::vec3 &value)
+{
+    glUniform3fv(location, 1, &value[0]);
+}
+void setUniform(GLint location, const glm::vec4 &value)
+{
+    glUniform4fv(location, 1, &value[0]);
+}
+void setUniform(GLint location, const glm::mat2 &mat)
+{
+    glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+void setUniform(GLint location, const glm::mat3 &mat)
+{
+    glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+void setUniform(GLint location, const glm::mat4 &mat)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
 // utility uniform functions
 // ------------------------------------------------------------------------
 void Shader::setBool(const std::string &name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(getUniformLocation(name), (int)value);
 }
 // ------------------------------------------------------------------------
 void Shader::setInt(const std::string &name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(getUniformLocation(name), value);
 }
 // ------------------------------------------------------------------------
 void Shader::setFloat(const std::string &name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(getUniformLocation(name), value);
 }
 // ------------------------------------------------------------------------
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(getUniformLocation(name), 1, &value[0]);
 }
 void Shader::setVec2(const std::string &name, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(getUniformLocation(name), x, y);
 }
 // ------------------------------------------------------------------------
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(getUniformLocation(name), 1, &value[0]);
 }
 void Shader::setVec3(const std::string &name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(getUniformLocation(name), x, y, z);
 }
 // ------------------------------------------------------------------------
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(getUniformLocation(name), 1, &value[0]);
 }
 void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(getUniformLocation(name), x, y, z, w);
 }
 // ------------------------------------------------------------------------
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 // ------------------------------------------------------------------------
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+}
+// ------------------------------------------------------------------------
+void Shader::bindUniformBlock(const char *blockName, GLuint binding) const
+{
+    GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+    // The block can be optimized out if the program doesn't use it
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, blockIndex, binding);
 }
 
 // Checks if the different Shaders have compiled properly
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Command line tools, they only use the sources that don't need OpenGL
+cd "$(dirname "$0")/.."
+g++ -std=c++17 -O2 tools/terrain_gen.cpp src/perlin.cpp src/Heightmap.cpp src/MeshExporter.cpp src/TileGenerator.cpp src/Trace.cpp -o terrain_gen -lpthread
+g++ -std=c++17 -O2 tools/tile_server.cpp src/perlin.cpp src/Heightmap.cpp src/TileGenerator.cpp -o tile_server -lpthread
+g++ -std=c++17 -O2 tools/golden_check.cpp src/perlin.cpp src/TileGenerator.cpp src/Heightmap.cpp src/MeshExporter.cpp -o golden_check -lpthread
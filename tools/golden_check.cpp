@@ -0,0 +1,133 @@
+// Checks the heightmaps of the golden file without a window or OpenGL
+// Every case is regenerated with TileGenerator, split in bands of rows like
+// Terrain does for every thread count, and its checksum must match exactly.
+// Every case is also exported with MeshExporter and read back, all the triangles
+// must face the same side as their vertex normals
+// The mesh checksums need Terrain, TERRAIN_VERIFY=golden/terrain.txt ./app checks them
+//
+//   tools/build.sh
+//   ./golden_check golden/terrain.txt
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+
+#include "../include/TileGenerator.h"
+#include "../include/MeshExporter.h"
+
+using namespace std;
+
+// Same as GoldenCheck
+const int GOLDEN_SAMPLES = 9;
+const int THREAD_COUNTS[] = {1, 2, 3, 4, 8};
+
+// FNV-1a, the same checksum as GoldenCheck
+static uint64_t checksum(const void *data, size_t bytes)
+{
+    uint64_t value = 1469598103934665603ull;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        value ^= ((const unsigned char *)data)[i];
+        value *= 1099511628211ull;
+    }
+    return value;
+}
+
+// The (dimension + 1)^2 heights of Terrain, the rows split in one band per thread
+static vector<float> generate(const TileGenerator &generator, int threads)
+{
+    int n = generator.getOptions().size;
+    vector<float> heights((size_t)n * n);
+    int bands = max(1, min(threads, n));
+    vector<thread> workers;
+    for (int band = 0; band < bands; band++)
+    {
+        int first = band * n / bands, last = (band + 1) * n / bands;
+        workers.emplace_back([&, first, last]()
+                             { generator.generateRegion(0, first, n, last - first, heights.data() + (size_t)first * n); });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    return heights;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        cout << "usage: golden_check golden/terrain.txt\n";
+        return 2;
+    }
+    ifstream file(argv[1]);
+    if (!file)
+    {
+        cout << "ERROR::GOLDEN::CANNOT_READ: " << argv[1] << "\n";
+        return 1;
+    }
+    int failures = 0, checks = 0;
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream in(line);
+        GenerationOptions options;
+        int dimension;
+        uint64_t heightmap, mesh;
+        float samples[GOLDEN_SAMPLES];
+        in >> options.seed >> dimension >> options.layers >> options.frequency >> options.persistance >> options.lacunarity >> hex >> heightmap >> mesh >> dec;
+        for (int i = 0; i < GOLDEN_SAMPLES; i++)
+            in >> samples[i];
+        if (!in)
+        {
+            cout << "ERROR::GOLDEN::BAD_LINE: " << line << "\n";
+            failures++;
+            continue;
+        }
+        options.size = dimension + 1;
+        TileGenerator generator(options);
+
+        for (int threads : THREAD_COUNTS)
+        {
+            vector<float> heights = generate(generator, threads);
+            checks++;
+            bool same = checksum(heights.data(), heights.size() * sizeof(float)) == heightmap;
+            cout << "seed " << options.seed << " dim " << dimension << " layers " << options.layers
+                 << " threads " << threads << ": " << (same ? "ok" : "FAIL (heightmap)");
+            if (!same)
+            {
+                failures++;
+                // Tells a few last bits from a real change
+                float maxError = 0.0f;
+                int n = options.size;
+                for (int i = 0; i < GOLDEN_SAMPLES; i++)
+                    maxError = max(maxError, fabs(heights[((i * 37 + 5) % n) * n + (i * 53 + 11) % n] - samples[i]));
+                cout << " max error " << maxError;
+            }
+            cout << "\n";
+        }
+
+        HeightSource source;
+        source.width = source.height = options.size;
+        source.read = [&generator](int x, int y, int w, int h, float *out)
+        { generator.generateRegion(x, y, w, h, out); };
+        string path = "/tmp/golden_check_" + to_string(getpid()) + ".ply";
+        uint64_t flipped = 0;
+        bool read = MeshExporter::writePLY(path, source, MeshExportOptions()) && MeshExporter::checkWinding(path, flipped);
+        remove(path.c_str());
+        checks++;
+        string status = !read ? "FAIL (export)" : flipped ? "FAIL (" + to_string(flipped) + " triangles flipped)" : "ok";
+        if (status != "ok")
+            failures++;
+        cout << "seed " << options.seed << " dim " << dimension << " layers " << options.layers << " winding: " << status << "\n";
+    }
+    cout << "Golden: " << checks - failures << "/" << checks << " checks passed, mesh checksums not checked (needs the app)\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,628 @@
+// Out-of-core generation of maps larger than memory
+// The map is made tile by tile straight into a tiled heightmap (and optionally a
+// tiled normal map), only the tiles in flight are held in memory. Progress is
+// checkpointed next to the output, so an interrupted run continues with --resume
+//
+//   tools/build.sh
+//   ./terrain_gen --size 65537 --seed 7 --layers 6 --normals --out big.hmt
+//   ./terrain_gen --size 65537 --seed 7 --layers 6 --normals --out big.hmt --resume
+//
+// With --processes or --endpoint the tiles are made by other processes running
+// terrain_gen --serve, on this machine or through any command that forwards
+// stdin and stdout (ssh). Every sample comes from its global position and the
+// shared seed, so the tiles of different workers meet without seams
+//   ./terrain_gen --size 65537 --seed 7 --out big.hmt --endpoint "ssh box1 ./terrain_gen" --endpoint "ssh box2 ./terrain_gen"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <climits>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../include/TileGenerator.h"
+#include "../include/Heightmap.h"
+#include "../include/MeshExporter.h"
+#include "../include/Trace.h"
+
+using namespace std;
+
+const char CHECKPOINT_MAGIC[4] = {'H', 'M', 'C', 'K'};
+// Seconds between checkpoints, each one waits for the outputs to reach the disk
+const double CHECKPOINT_INTERVAL = 1.0;
+// Tiles requested from a worker process before its first one comes back, keeps it busy
+const int WORKER_PIPELINE = 4;
+
+struct Settings
+{
+    GenerationOptions generation;
+    int tileSize = 256;
+    string out = "heightmap.hmt";
+    bool normals = false;
+    size_t memoryMB = 256;
+    int threads = max(1u, thread::hardware_concurrency());
+    bool resume = false;
+    string mesh;
+    string trace;
+    // Coordinator: local worker processes and commands that start remote ones
+    int processes = 0;
+    vector<string> endpoints;
+    // Worker: answers tile requests on stdin/stdout
+    bool serve = false;
+
+    // Identifies the tiles, a checkpoint or a worker with another hash is refused
+    uint64_t hash() const { return generation.hash() ^ ((uint64_t)tileSize << 32) ^ normals; }
+};
+
+// Which tiles are safely on disk, stored as is after a small header
+struct Checkpoint
+{
+    uint64_t hash = 0;
+    float minHeight = 0.0f, maxHeight = 0.0f;
+    vector<char> done;
+
+    bool save(const string &path) const;
+    bool load(const string &path);
+};
+
+bool Checkpoint::save(const string &path) const
+{
+    // Written aside and renamed, so there is always a whole checkpoint on disk
+    string temp = path + ".tmp";
+    {
+        ofstream file(temp, ios::binary | ios::trunc);
+        uint64_t tiles = done.size();
+        file.write(CHECKPOINT_MAGIC, 4);
+        file.write((const char *)&hash, sizeof(hash));
+        file.write((const char *)&tiles, sizeof(tiles));
+        file.write((const char *)&minHeight, sizeof(minHeight));
+        file.write((const char *)&maxHeight, sizeof(maxHeight));
+        file.write(done.data(), done.size());
+        if (!file)
+        {
+            cout << "ERROR::GENERATOR::CANNOT_WRITE: " << temp << "\n";
+            return false;
+        }
+    }
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool Checkpoint::load(const string &path)
+{
+    ifstream file(path, ios::binary);
+    char magic[4];
+    uint64_t tiles = 0;
+    file.read(magic, 4);
+    file.read((char *)&hash, sizeof(hash));
+    file.read((char *)&tiles, sizeof(tiles));
+    file.read((char *)&minHeight, sizeof(minHeight));
+    file.read((char *)&maxHeight, sizeof(maxHeight));
+    if (!file || memcmp(magic, CHECKPOINT_MAGIC, 4) != 0)
+        return false;
+    done.resize(tiles);
+    file.read(done.data(), done.size());
+    return (bool)file;
+}
+
+static void usage()
+{
+    cout << "terrain_gen [options]\n"
+            "  --size N           samples per side (1025)\n"
+            "  --seed N           (0)\n"
+            "  --layers N --frequency F --persistance F --lacunarity F\n"
+            "  --tile N           samples per tile side (256)\n"
+            "  --out PATH         tiled heightmap (heightmap.hmt)\n"
+            "  --normals          also write PATH.normals.hmt\n"
+            "  --distance F --map-height F   scale of the normals (0.1, 3.5)\n"
+            "  --memory-mb N      cap of the tiles in flight (256)\n"
+            "  --threads N\n"
+            "  --resume           continue from PATH.ckpt\n"
+            "  --mesh PATH        then stream the mesh to .ply or .gltf\n"
+            "  --trace PATH       Chrome trace of the run\n"
+            "  --processes N      make the tiles in N local worker processes\n"
+            "  --endpoint CMD     command that starts terrain_gen on a worker box, repeatable\n"
+            "  --serve            worker mode, tile requests on stdin, tiles on stdout\n";
+}
+
+static bool parse(int argc, char **argv, Settings &settings)
+{
+    GenerationOptions &g = settings.generation;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--normals")
+            settings.normals = true;
+        else if (arg == "--resume")
+            settings.resume = true;
+        else if (arg == "--serve")
+            settings.serve = true;
+        else if (i + 1 >= argc)
+            return false;
+        else
+        {
+            const char *value = argv[++i];
+            if (arg == "--size")
+                g.size = atoi(value);
+            else if (arg == "--seed")
+                g.seed = strtoul(value, nullptr, 10);
+            else if (arg == "--layers")
+                g.layers = atoi(value);
+            else if (arg == "--frequency")
+                g.frequency = atof(value);
+            else if (arg == "--persistance")
+                g.persistance = atof(value);
+            else if (arg == "--lacunarity")
+                g.lacunarity = atof(value);
+            else if (arg == "--distance")
+                g.distance = atof(value);
+            else if (arg == "--map-height")
+                g.mapHeight = atof(value);
+            else if (arg == "--tile")
+                settings.tileSize = atoi(value);
+            else if (arg == "--out")
+                settings.out = value;
+            else if (arg == "--memory-mb")
+                settings.memoryMB = atol(value);
+            else if (arg == "--threads")
+                settings.threads = atoi(value);
+            else if (arg == "--mesh")
+                settings.mesh = value;
+            else if (arg == "--trace")
+                settings.trace = value;
+            else if (arg == "--processes")
+                settings.processes = atoi(value);
+            else if (arg == "--endpoint")
+                settings.endpoints.push_back(value);
+            else
+                return false;
+        }
+    }
+    return g.size > 1 && settings.tileSize > 0 && settings.threads > 0;
+}
+
+static bool readAll(int fd, void *data, size_t bytes)
+{
+    char *at = (char *)data;
+    while (bytes > 0)
+    {
+        ssize_t count = read(fd, at, bytes);
+        if (count <= 0)
+            return false;
+        at += count;
+        bytes -= count;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *data, size_t bytes)
+{
+    const char *at = (const char *)data;
+    while (bytes > 0)
+    {
+        ssize_t count = write(fd, at, bytes);
+        if (count <= 0)
+            return false;
+        at += count;
+        bytes -= count;
+    }
+    return true;
+}
+
+// What goes through the pipes: the worker first sends its Settings hash, then for
+// every request {tx, ty} it sends back {tx, ty}, the heights and the packed normals
+struct TileRequest
+{
+    uint32_t tx, ty;
+};
+
+static int serve(const Settings &settings)
+{
+    TileGenerator generator(settings.generation);
+    int T = settings.tileSize;
+    vector<float> tile((size_t)T * T), scratch;
+    vector<uint32_t> packed(settings.normals ? (size_t)T * T : 0);
+    uint64_t hash = settings.hash();
+    if (!writeAll(STDOUT_FILENO, &hash, sizeof(hash)))
+        return 1;
+    TileRequest request;
+    while (readAll(STDIN_FILENO, &request, sizeof(request)))
+    {
+        generator.generateTile(request.tx, request.ty, T, tile.data());
+        if (settings.normals)
+            generator.generateNormals(request.tx, request.ty, T, packed.data(), scratch);
+        if (!writeAll(STDOUT_FILENO, &request, sizeof(request)) ||
+            !writeAll(STDOUT_FILENO, tile.data(), tile.size() * sizeof(float)) ||
+            !writeAll(STDOUT_FILENO, packed.data(), packed.size() * sizeof(uint32_t)))
+            return 1;
+    }
+    // The coordinator closed stdin, there is nothing left to do
+    return 0;
+}
+
+// A worker started through /bin/sh -c, its stdin and stdout are pipes
+class WorkerProcess
+{
+public:
+    bool start(const string &command);
+    void stop();
+    int in = -1, out = -1;
+
+private:
+    pid_t pid = -1;
+};
+
+bool WorkerProcess::start(const string &command)
+{
+    int toWorker[2], fromWorker[2];
+    if (pipe(toWorker) != 0)
+        return false;
+    if (pipe(fromWorker) != 0)
+    {
+        close(toWorker[0]);
+        close(toWorker[1]);
+        return false;
+    }
+    pid = fork();
+    if (pid == 0)
+    {
+        dup2(toWorker[0], STDIN_FILENO);
+        dup2(fromWorker[1], STDOUT_FILENO);
+        close(toWorker[0]);
+        close(toWorker[1]);
+        close(fromWorker[0]);
+        close(fromWorker[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    in = toWorker[1];
+    out = fromWorker[0];
+    return pid > 0;
+}
+
+void WorkerProcess::stop()
+{
+    // Closing stdin ends the request loop of the worker
+    if (in >= 0)
+        close(in);
+    if (out >= 0)
+        close(out);
+    in = out = -1;
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    pid = -1;
+}
+
+// The tiles left to make and the outputs they go to, shared by the threads that
+// make them and the ones that talk to the worker processes
+struct Job
+{
+    const Settings &settings;
+    TileGenerator generator;
+    TiledHeightmapWriter heights, normals;
+    int tilesX = 0;
+
+    deque<size_t> queue;
+    mutex queueMutex;
+    // Signaled when a tile is stored or handed back and when the job fails
+    condition_variable queueChanged;
+    // Tiles taken from the queue and not yet stored or handed back, guarded by queueMutex
+    size_t inFlight = 0;
+    // Written tiles the checkpoint doesn't have yet
+    vector<size_t> finished;
+    mutex finishedMutex;
+    atomic<bool> failed{false};
+    atomic<int> running{0};
+
+    Job(const Settings &settings) : settings(settings), generator(settings.generation) {}
+
+    // With wait, an empty queue isn't the end while other workers still have tiles,
+    // a worker that goes away may hand them back. Only a caller holding no tiles may wait
+    bool next(size_t &tile, bool wait)
+    {
+        unique_lock<mutex> lock(queueMutex);
+        if (wait)
+            queueChanged.wait(lock, [this]()
+                              { return !queue.empty() || inFlight == 0 || failed; });
+        if (queue.empty() || failed)
+            return false;
+        tile = queue.front();
+        queue.pop_front();
+        inFlight++;
+        return true;
+    }
+    // Stops the workers, the waiting ones too
+    void fail()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            failed = true;
+        }
+        queueChanged.notify_all();
+    }
+    // A worker that went away hands back the tiles it didn't send
+    void giveBack(const deque<size_t> &tiles)
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            queue.insert(queue.end(), tiles.begin(), tiles.end());
+            inFlight -= tiles.size();
+        }
+        queueChanged.notify_all();
+    }
+    bool store(size_t tile, const float *heightTile, const uint32_t *normalTile)
+    {
+        int tx = tile % tilesX, ty = tile / tilesX;
+        bool ok = heights.writeTile(tx, ty, heightTile);
+        if (settings.normals)
+            ok &= normals.writeTile(tx, ty, normalTile);
+        {
+            lock_guard<mutex> lock(queueMutex);
+            inFlight--;
+        }
+        queueChanged.notify_all();
+        if (!ok)
+        {
+            fail();
+            return false;
+        }
+        lock_guard<mutex> lock(finishedMutex);
+        finished.push_back(tile);
+        return true;
+    }
+};
+
+static void generateTiles(Job &job)
+{
+    Trace::setThreadName("Generator");
+    int T = job.settings.tileSize;
+    vector<float> tile((size_t)T * T), scratch;
+    vector<uint32_t> packed(job.settings.normals ? (size_t)T * T : 0);
+    size_t next;
+    while (job.next(next, true))
+    {
+        int tx = next % job.tilesX, ty = next / job.tilesX;
+        TraceScope scope("Tile", {{"tx", tx}, {"ty", ty}});
+        job.generator.generateTile(tx, ty, T, tile.data());
+        if (job.settings.normals)
+            job.generator.generateNormals(tx, ty, T, packed.data(), scratch);
+        if (!job.store(next, tile.data(), packed.data()))
+            break;
+    }
+    job.running--;
+}
+
+// Feeds one worker process, a few requests ahead, and stores what it sends back
+static void driveWorker(Job &job, const string &command)
+{
+    Trace::setThreadName(command);
+    int T = job.settings.tileSize;
+    vector<float> tile((size_t)T * T);
+    vector<uint32_t> packed(job.settings.normals ? (size_t)T * T : 0);
+    deque<size_t> pending;
+    WorkerProcess worker;
+    uint64_t hash = 0;
+    bool ok = worker.start(command) && readAll(worker.out, &hash, sizeof(hash));
+    if (ok && hash != job.settings.hash())
+    {
+        cout << "ERROR::GENERATOR::WORKER_MISMATCH: " << command << "\n";
+        ok = false;
+    }
+
+    // Waits for handed back tiles only when nothing is pending
+    auto request = [&]()
+    {
+        size_t next;
+        if (!job.next(next, pending.empty()))
+            return true;
+        pending.push_back(next);
+        TileRequest message = {(uint32_t)(next % job.tilesX), (uint32_t)(next / job.tilesX)};
+        return writeAll(worker.in, &message, sizeof(message));
+    };
+    for (int i = 0; i < WORKER_PIPELINE && ok; i++)
+        ok = request();
+    while (ok && !pending.empty())
+    {
+        TraceScope scope("Receive tile");
+        TileRequest reply;
+        ok = readAll(worker.out, &reply, sizeof(reply)) &&
+             readAll(worker.out, tile.data(), tile.size() * sizeof(float)) &&
+             readAll(worker.out, packed.data(), packed.size() * sizeof(uint32_t));
+        // The requests are answered in order
+        ok = ok && reply.ty * (size_t)job.tilesX + reply.tx == pending.front();
+        if (!ok)
+            break;
+        pending.pop_front();
+        ok = job.store(reply.ty * (size_t)job.tilesX + reply.tx, tile.data(), packed.data()) && request();
+    }
+    if (!ok && !job.failed)
+        cout << "ERROR::GENERATOR::WORKER_FAILED: " << command << ", its tiles go to the other workers\n";
+    job.giveBack(pending);
+    worker.stop();
+    job.running--;
+}
+
+// Command that starts this same program as a local worker
+static string localWorkerCommand()
+{
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return "./terrain_gen";
+    path[length] = '\0';
+    return string("'") + path + "'";
+}
+
+// Worker arguments for the same map, %a keeps the floats exact
+static string workerArguments(const Settings &settings)
+{
+    const GenerationOptions &g = settings.generation;
+    char arguments[512];
+    snprintf(arguments, sizeof(arguments),
+             " --serve --size %d --seed %u --layers %d --frequency %a --persistance %a --lacunarity %a"
+             " --distance %a --map-height %a --tile %d%s",
+             g.size, g.seed, g.layers, g.frequency, g.persistance, g.lacunarity,
+             g.distance, g.mapHeight, settings.tileSize, settings.normals ? " --normals" : "");
+    return arguments;
+}
+
+int main(int argc, char **argv)
+{
+    Settings settings;
+    if (!parse(argc, argv, settings))
+    {
+        usage();
+        return 1;
+    }
+    if (settings.serve)
+        return serve(settings);
+    if (!settings.trace.empty())
+        Trace::start(settings.trace);
+
+    const GenerationOptions &g = settings.generation;
+    Job job(settings);
+    int T = settings.tileSize;
+    string normalsPath = settings.out + ".normals.hmt";
+    string checkpointPath = settings.out + ".ckpt";
+
+    // The tiles in flight are the only memory that grows with the work
+    size_t tileMemory = (size_t)T * T * sizeof(float) + (settings.normals ? (size_t)T * T * 4 + (size_t)(T + 2) * (T + 2) * sizeof(float) : 0);
+    int threads = (int)min<size_t>(settings.threads, max<size_t>(1, settings.memoryMB * 1024 * 1024 / tileMemory));
+
+    Checkpoint checkpoint;
+    bool resumed = settings.resume && checkpoint.load(checkpointPath);
+    if (!job.heights.create(settings.out, g.size, g.size, T, TILE_FLOAT32, resumed))
+        return 1;
+    const TiledHeader &header = job.heights.getHeader();
+    job.tilesX = header.tilesX(0);
+    size_t tiles = (size_t)header.tilesX(0) * header.tilesY(0);
+    if (resumed && (checkpoint.hash != settings.hash() || checkpoint.done.size() != tiles))
+    {
+        cout << "ERROR::GENERATOR::CHECKPOINT_MISMATCH: " << checkpointPath << " is from other options\n";
+        return 1;
+    }
+    if (settings.normals && !job.normals.create(normalsPath, g.size, g.size, T, TILE_NORMAL_RGBA8, resumed))
+        return 1;
+    if (!resumed)
+    {
+        checkpoint.hash = settings.hash();
+        checkpoint.done.assign(tiles, 0);
+    }
+    else
+        job.heights.setRange(checkpoint.minHeight, checkpoint.maxHeight);
+
+    for (size_t i = 0; i < tiles; i++)
+    {
+        if (!checkpoint.done[i])
+            job.queue.push_back(i);
+    }
+    size_t todo = job.queue.size();
+
+    // The tiles are made here, or by worker processes that only send them back
+    vector<string> commands = settings.endpoints;
+    for (int i = 0; i < settings.processes; i++)
+        commands.push_back(localWorkerCommand());
+    for (auto &command : commands)
+        command += workerArguments(settings);
+    cout << g.size << " x " << g.size << " samples, " << tiles << " tiles of " << T << ", "
+         << tiles - todo << " already done, ";
+    if (commands.empty())
+        cout << threads << " threads, " << threads * tileMemory / 1024 << " KB in flight\n";
+    else
+        cout << commands.size() << " worker processes\n";
+
+    // A worker that dies shouldn't take the coordinator with it
+    signal(SIGPIPE, SIG_IGN);
+    vector<thread> workers;
+    job.running = commands.empty() ? threads : commands.size();
+    if (commands.empty())
+    {
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back(generateTiles, ref(job));
+    }
+    for (auto &command : commands)
+        workers.emplace_back(driveWorker, ref(job), command);
+
+    // The reported tiles are made durable and then recorded in the checkpoint
+    auto start = chrono::steady_clock::now();
+    size_t written = 0;
+    auto saveCheckpoint = [&]()
+    {
+        vector<size_t> batch;
+        {
+            lock_guard<mutex> lock(job.finishedMutex);
+            batch.swap(job.finished);
+        }
+        if (batch.empty())
+            return true;
+        // Only tiles that were written before the sync are recorded
+        if (!job.heights.sync() || (settings.normals && !job.normals.sync()))
+            return false;
+        for (size_t tile : batch)
+            checkpoint.done[tile] = 1;
+        job.heights.getRange(checkpoint.minHeight, checkpoint.maxHeight);
+        written += batch.size();
+        return checkpoint.save(checkpointPath);
+    };
+    auto lastSave = start;
+    bool done = false;
+    while (!done && !job.failed)
+    {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        done = job.running == 0;
+        if (!done && chrono::steady_clock::now() - lastSave < chrono::duration<double>(CHECKPOINT_INTERVAL))
+            continue;
+        lastSave = chrono::steady_clock::now();
+        if (!saveCheckpoint())
+            job.fail();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        double samples = (double)written * T * T;
+        printf("\r%zu / %zu tiles, %.1f Msamples/s", written, todo, samples / elapsed.count() / 1.0e6);
+        fflush(stdout);
+    }
+    for (auto &worker : workers)
+        worker.join();
+    printf("\n");
+    if (job.failed || written < todo)
+    {
+        cout << "ERROR::GENERATOR::WRITE_FAILED: " << settings.out << ", run again with --resume\n";
+        return 1;
+    }
+
+    // The mip levels are built from the finished level 0
+    if (!job.heights.finish() || (settings.normals && !job.normals.finish()))
+        return 1;
+    remove(checkpointPath.c_str());
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Done in " << elapsed.count() << " s\n";
+
+    if (!settings.mesh.empty())
+    {
+        TiledHeightmap tiled;
+        if (!tiled.open(settings.out))
+            return 1;
+        // The mesh indices are 32 bit, past that a coarser level is exported at the same extent
+        int level = tiled.levelFor(UINT16_MAX);
+        MeshExportOptions options;
+        options.distance = g.distance * (1 << level);
+        options.mapHeight = g.mapHeight;
+        HeightSource source = HeightSource::fromTiled(tiled, level);
+        bool gltf = settings.mesh.size() > 5 && settings.mesh.compare(settings.mesh.size() - 5, 5, ".gltf") == 0;
+        if (!(gltf ? MeshExporter::writeGLTF(settings.mesh, source, options)
+                   : MeshExporter::writePLY(settings.mesh, source, options)))
+            return 1;
+    }
+    Trace::stop();
+    return 0;
+}
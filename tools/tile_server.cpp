@@ -0,0 +1,492 @@
+// Heightmap tiles over HTTP on localhost, made on demand by the headless generator
+//
+//   tools/build.sh
+//   ./tile_server --port 8080 --threads 8 --memory-mb 256 --cache-dir tile_cache
+//   curl -o tile.r32 "http://127.0.0.1:8080/tile/2/1/3?seed=7&size=8193&layers=6&frequency=4"
+//   curl http://127.0.0.1:8080/stats
+//
+// /tile/z/x/y is tile (x, y) of mip level z, the same tiles terrain_gen writes for
+// those options: tileSize x tileSize little endian float32 (or packed RGBA8 normals
+// with normals=1). The options are seed, size, layers, frequency, persistance,
+// lacunarity, tile, distance, map-height and normals. Level 0 tiles are generated,
+// the others are filtered from the four tiles under them, which go through the
+// cache too. Tiles are kept in a memory LRU and in the cache directory, and
+// requests for a tile that is being made wait for it instead of making it again.
+// A connection that doesn't send its request within REQUEST_TIMEOUT gets a 408
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../include/TileGenerator.h"
+#include "../include/Heightmap.h"
+#include "../include/LRUCache.h"
+
+using namespace std;
+
+// Largest request head read, the requests have no body
+const size_t MAX_REQUEST = 8192;
+// Seconds between the statistics lines, only printed when there were requests
+const double STATS_INTERVAL = 10.0;
+const int MAX_TILE_SIZE = 1024;
+// Seconds a client has to send the whole request head, and to take each part of
+// the reply. An idle connection would hold a pool thread otherwise
+const double REQUEST_TIMEOUT = 5.0;
+
+typedef shared_ptr<const vector<float>> TileData;
+
+// Where a tile came from, also sent back in X-Cache
+enum TileSource
+{
+    FROM_MEMORY,
+    FROM_DISK,
+    FROM_GENERATOR,
+    FROM_OTHER_REQUEST,
+};
+const char *SOURCE_NAMES[] = {"memory", "disk", "generated", "coalesced"};
+
+// The map a tile belongs to, from the query of the request
+struct MapOptions
+{
+    GenerationOptions generation;
+    int tileSize = 256;
+    TileFormat format = TILE_FLOAT32;
+    TiledHeader header;
+    // Names the map in the cache keys and files
+    string id;
+};
+
+struct ServerStats
+{
+    atomic<uint64_t> requests{0}, errors{0}, bytesSent{0}, latencyMicros{0};
+    // Lookups of every tile, the filtered levels also look up the tiles under them
+    atomic<uint64_t> lookups[4] = {};
+};
+
+class TileStore
+{
+public:
+    TileStore(size_t memoryBudget, const string &directory, ServerStats &stats)
+        : memory(memoryBudget), directory(directory), stats(stats) {}
+
+    // The tile from the fastest place that has it, made at most once at a time
+    TileData get(const MapOptions &map, int z, int x, int y, TileSource &source);
+
+    void getMemory(size_t &bytes, size_t &tiles, size_t &evictions)
+    {
+        lock_guard<mutex> lock(storeMutex);
+        bytes = memory.getBytes();
+        tiles = memory.size();
+        evictions = memory.getEvictions();
+    }
+
+private:
+    LRUCache<string, TileData> memory;
+    // Tiles being made, the requests that find one here wait for it
+    unordered_map<string, shared_future<TileData>> making;
+    mutex storeMutex;
+    string directory;
+    ServerStats &stats;
+
+    TileData make(const MapOptions &map, int z, int x, int y, const string &key, TileSource &source);
+    TileData load(const string &key, size_t samples);
+    void save(const string &key, const vector<float> &tile);
+};
+
+TileData TileStore::get(const MapOptions &map, int z, int x, int y, TileSource &source)
+{
+    string key = map.id + "_" + to_string(z) + "_" + to_string(x) + "_" + to_string(y);
+    promise<TileData> made;
+    shared_future<TileData> pending;
+    {
+        lock_guard<mutex> lock(storeMutex);
+        TileData data;
+        if (memory.get(key, data))
+        {
+            source = FROM_MEMORY;
+            stats.lookups[source]++;
+            return data;
+        }
+        auto other = making.find(key);
+        if (other != making.end())
+            pending = other->second;
+        else
+            making[key] = made.get_future().share();
+    }
+    // Waits without the lock, the request making it needs it to finish
+    if (pending.valid())
+    {
+        source = FROM_OTHER_REQUEST;
+        stats.lookups[source]++;
+        return pending.get();
+    }
+
+    TileData data = make(map, z, x, y, key, source);
+    stats.lookups[source]++;
+    {
+        lock_guard<mutex> lock(storeMutex);
+        memory.put(key, data, data->size() * sizeof(float));
+        making.erase(key);
+    }
+    made.set_value(data);
+    return data;
+}
+
+TileData TileStore::make(const MapOptions &map, int z, int x, int y, const string &key, TileSource &source)
+{
+    int T = map.tileSize;
+    TileData data = load(key, (size_t)T * T);
+    if (data)
+    {
+        source = FROM_DISK;
+        return data;
+    }
+    source = FROM_GENERATOR;
+    auto tile = make_shared<vector<float>>((size_t)T * T);
+    if (z == 0)
+    {
+        TileGenerator generator(map.generation);
+        if (map.format == TILE_FLOAT32)
+            generator.generateTile(x, y, T, tile->data());
+        else
+        {
+            vector<float> scratch;
+            generator.generateNormals(x, y, T, (uint32_t *)tile->data(), scratch);
+        }
+    }
+    else
+    {
+        // Same filter as the mip levels of the tiled files
+        vector<float> block(4 * (size_t)T * T);
+        for (int q = 0; q < 4; q++)
+        {
+            int px = 2 * x + (q & 1), py = 2 * y + (q >> 1);
+            if (px >= map.header.tilesX(z - 1) || py >= map.header.tilesY(z - 1))
+                continue;
+            TileSource childSource;
+            TileData child = get(map, z - 1, px, py, childSource);
+            for (int row = 0; row < T; row++)
+                copy(&(*child)[row * T], &(*child)[row * T] + T, &block[((q >> 1) * T + row) * 2 * T + (q & 1) * T]);
+        }
+        TiledHeightmapWriter::downsample(map.header, z, x, y, block.data(), tile->data());
+    }
+    save(key, *tile);
+    return tile;
+}
+
+TileData TileStore::load(const string &key, size_t samples)
+{
+    if (directory.empty())
+        return nullptr;
+    ifstream file(directory + "/" + key + ".r32", ios::binary);
+    if (!file)
+        return nullptr;
+    auto tile = make_shared<vector<float>>(samples);
+    file.read((char *)tile->data(), samples * sizeof(float));
+    // A short file is from an older tile size or a failed write, it's made again
+    if (file.gcount() != (streamsize)(samples * sizeof(float)))
+        return nullptr;
+    return tile;
+}
+
+void TileStore::save(const string &key, const vector<float> &tile)
+{
+    if (directory.empty())
+        return;
+    // Written aside and renamed, a reader never sees half a tile
+    string path = directory + "/" + key + ".r32";
+    string temp = path + "." + to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+    {
+        ofstream file(temp, ios::binary | ios::trunc);
+        file.write((const char *)tile.data(), tile.size() * sizeof(float));
+        if (!file)
+        {
+            cout << "ERROR::TILE_SERVER::CANNOT_WRITE: " << temp << "\n";
+            return;
+        }
+    }
+    rename(temp.c_str(), path.c_str());
+}
+
+// Connections accepted by the main thread and handled by the pool
+class ConnectionQueue
+{
+public:
+    void push(int connection)
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            connections.push_back(connection);
+        }
+        ready.notify_one();
+    }
+    int pop()
+    {
+        unique_lock<mutex> lock(queueMutex);
+        ready.wait(lock, [this]()
+                   { return !connections.empty(); });
+        int connection = connections.front();
+        connections.pop_front();
+        return connection;
+    }
+
+private:
+    deque<int> connections;
+    mutex queueMutex;
+    condition_variable ready;
+};
+
+static map<string, string> parseQuery(const string &query)
+{
+    map<string, string> values;
+    stringstream stream(query);
+    string pair;
+    while (getline(stream, pair, '&'))
+    {
+        size_t equals = pair.find('=');
+        if (equals != string::npos)
+            values[pair.substr(0, equals)] = pair.substr(equals + 1);
+    }
+    return values;
+}
+
+// Fills map from the query, false when an option is out of range
+static bool parseMap(const string &query, MapOptions &map)
+{
+    auto values = parseQuery(query);
+    auto number = [&values](const char *name, double fallback)
+    { return values.count(name) ? atof(values[name].c_str()) : fallback; };
+    GenerationOptions &g = map.generation;
+    g.seed = (unsigned int)number("seed", g.seed);
+    g.size = (int)number("size", g.size);
+    g.layers = (int)number("layers", g.layers);
+    g.frequency = number("frequency", g.frequency);
+    g.persistance = number("persistance", g.persistance);
+    g.lacunarity = number("lacunarity", g.lacunarity);
+    g.distance = number("distance", g.distance);
+    g.mapHeight = number("map-height", g.mapHeight);
+    map.tileSize = (int)number("tile", map.tileSize);
+    map.format = number("normals", 0) != 0 ? TILE_NORMAL_RGBA8 : TILE_FLOAT32;
+    if (g.size < 2 || g.layers < 1 || g.layers > 16 || map.tileSize < 1 || map.tileSize > MAX_TILE_SIZE)
+        return false;
+    map.header = TiledHeader::describe(g.size, g.size, map.tileSize, map.format);
+    char id[32];
+    snprintf(id, sizeof(id), "%016llx", (unsigned long long)(g.hash() ^ ((uint64_t)map.tileSize << 32) ^ map.format));
+    map.id = id;
+    return true;
+}
+
+static void respond(int connection, const string &status, const string &headers, const void *body, size_t bytes)
+{
+    string head = "HTTP/1.1 " + status + "\r\nContent-Length: " + to_string(bytes) + "\r\n" + headers + "Connection: close\r\n\r\n";
+    send(connection, head.data(), head.size(), MSG_NOSIGNAL);
+    const char *at = (const char *)body;
+    while (bytes > 0)
+    {
+        ssize_t count = send(connection, at, bytes, MSG_NOSIGNAL);
+        if (count <= 0)
+            return;
+        at += count;
+        bytes -= count;
+    }
+}
+
+static void respondText(int connection, const string &status, const string &type, const string &text)
+{
+    respond(connection, status, "Content-Type: " + type + "\r\n", text.data(), text.size());
+}
+
+static string statsJSON(TileStore &store, ServerStats &stats, chrono::steady_clock::time_point start)
+{
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    uint64_t requests = stats.requests;
+    uint64_t lookups = 0;
+    for (auto &count : stats.lookups)
+        lookups += count;
+    size_t bytes, tiles, evictions;
+    store.getMemory(bytes, tiles, evictions);
+    stringstream json;
+    json << "{\"requests\":" << requests << ",\"errors\":" << stats.errors
+         << ",\"requestsPerSecond\":" << requests / elapsed.count()
+         << ",\"megabytesSent\":" << stats.bytesSent / 1.0e6
+         << ",\"averageLatencyMs\":" << (requests ? stats.latencyMicros / 1000.0 / requests : 0.0)
+         << ",\"lookups\":" << lookups;
+    for (int i = 0; i < 4; i++)
+        json << ",\"" << SOURCE_NAMES[i] << "\":" << stats.lookups[i];
+    json << ",\"hitRate\":" << (lookups ? (double)(lookups - stats.lookups[FROM_GENERATOR]) / lookups : 0.0)
+         << ",\"memoryTiles\":" << tiles << ",\"memoryBytes\":" << bytes << ",\"evictions\":" << evictions << "}";
+    return json.str();
+}
+
+static void handle(int connection, TileStore &store, ServerStats &stats, chrono::steady_clock::time_point start)
+{
+    auto received = chrono::steady_clock::now();
+    auto deadline = received + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(REQUEST_TIMEOUT));
+    string request;
+    char buffer[1024];
+    bool timedOut = false;
+    while (request.find("\r\n\r\n") == string::npos && request.size() < MAX_REQUEST)
+    {
+        // The deadline covers the whole head, a byte now and then doesn't extend it
+        int left = (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        pollfd readable = {connection, POLLIN, 0};
+        if (left <= 0 || poll(&readable, 1, left) <= 0)
+        {
+            timedOut = true;
+            break;
+        }
+        ssize_t count = recv(connection, buffer, sizeof(buffer), 0);
+        if (count <= 0)
+            break;
+        request.append(buffer, count);
+    }
+    stats.requests++;
+    if (timedOut)
+    {
+        stats.errors++;
+        respondText(connection, "408 Request Timeout", "text/plain", "No request\n");
+        close(connection);
+        return;
+    }
+
+    // GET /path?query HTTP/1.1
+    string method, target;
+    stringstream(request) >> method >> target;
+    size_t question = target.find('?');
+    string path = target.substr(0, question);
+    string query = question == string::npos ? "" : target.substr(question + 1);
+
+    int z, x, y;
+    char end;
+    MapOptions map;
+    if (method != "GET")
+    {
+        stats.errors++;
+        respondText(connection, "405 Method Not Allowed", "text/plain", "GET only\n");
+    }
+    else if (path == "/stats")
+        respondText(connection, "200 OK", "application/json", statsJSON(store, stats, start) + "\n");
+    else if (sscanf(path.c_str(), "/tile/%d/%d/%d%c", &z, &x, &y, &end) != 3 || !parseMap(query, map))
+    {
+        stats.errors++;
+        respondText(connection, "400 Bad Request", "text/plain", "/tile/z/x/y?seed=&size=&layers=&frequency=&persistance=&lacunarity=&tile=&normals=\n");
+    }
+    else if (z < 0 || z >= (int)map.header.levels || x < 0 || y < 0 || x >= map.header.tilesX(z) || y >= map.header.tilesY(z))
+    {
+        stats.errors++;
+        respondText(connection, "404 Not Found", "text/plain", "No such tile\n");
+    }
+    else
+    {
+        TileSource source;
+        TileData tile = store.get(map, z, x, y, source);
+        string headers = "Content-Type: application/octet-stream\r\nX-Tile-Size: " + to_string(map.tileSize) +
+                         "\r\nX-Level-Size: " + to_string(map.header.levelWidth(z)) + "\r\nX-Cache: " + SOURCE_NAMES[source] + "\r\n";
+        respond(connection, "200 OK", headers, tile->data(), tile->size() * sizeof(float));
+        stats.bytesSent += tile->size() * sizeof(float);
+    }
+    close(connection);
+    stats.latencyMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - received).count();
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8080, threads = max(1u, thread::hardware_concurrency());
+    size_t memoryMB = 256;
+    string directory = "tile_cache";
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string arg = argv[i];
+        if (arg == "--port")
+            port = atoi(argv[i + 1]);
+        else if (arg == "--threads")
+            threads = max(1, atoi(argv[i + 1]));
+        else if (arg == "--memory-mb")
+            memoryMB = atol(argv[i + 1]);
+        else if (arg == "--cache-dir")
+            directory = argv[i + 1];
+        else
+        {
+            cout << "tile_server [--port 8080] [--threads N] [--memory-mb 256] [--cache-dir tile_cache, \"\" for none]\n";
+            return 1;
+        }
+    }
+    if (!directory.empty())
+        mkdir(directory.c_str(), 0755);
+
+    // Only reachable from this machine
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 128) != 0)
+    {
+        cout << "ERROR::TILE_SERVER::CANNOT_LISTEN: port " << port << "\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerStats stats;
+    TileStore store(memoryMB * 1024 * 1024, directory, stats);
+    ConnectionQueue queue;
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int i = 0; i < threads; i++)
+    {
+        pool.emplace_back([&]()
+                          {
+            while (true)
+                handle(queue.pop(), store, stats, start); });
+    }
+    cout << "Serving tiles on http://127.0.0.1:" << port << " with " << threads << " threads\n";
+
+    auto lastReport = start;
+    uint64_t lastRequests = 0;
+    while (true)
+    {
+        pollfd waiting = {listener, POLLIN, 0};
+        if (poll(&waiting, 1, 1000) > 0)
+        {
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection >= 0)
+            {
+                // A client that stops reading the reply can't hold the thread either
+                timeval timeout = {(time_t)REQUEST_TIMEOUT, 0};
+                setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                queue.push(connection);
+            }
+        }
+        chrono::duration<double> sinceReport = chrono::steady_clock::now() - lastReport;
+        if (sinceReport.count() >= STATS_INTERVAL && stats.requests != lastRequests)
+        {
+            cout << statsJSON(store, stats, start) << endl;
+            lastRequests = stats.requests;
+            lastReport = chrono::steady_clock::now();
+        }
+    }
+}